@@ -0,0 +1,57 @@
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+#include <include/audio_resampler.hxx>
+
+// Measures the mix and resample stage in input frames per second, one 60Hz frame of
+// four channels at a time, for the rate conversions the cores need
+namespace {
+    constexpr double min_seconds = 0.25;
+    constexpr int channel_count = 4;
+
+    struct Conversion {
+        const char* Name;
+        double InputRate;
+        double OutputRate;
+    };
+
+    double measure(const Conversion& conversion) {
+        size_t frames = conversion.InputRate / 60;
+        std::vector<std::vector<int16_t>> channels(channel_count, std::vector<int16_t>(frames * 2));
+        for (int c = 0; c < channel_count; c++) {
+            for (size_t i = 0; i < frames * 2; i++)
+                channels[c][i] = 4000 * std::sin(i * 0.01 * (c + 1));
+        }
+        TKPEmu::AudioMixer mixer;
+        TKPEmu::AudioResampler resampler(conversion.InputRate, conversion.OutputRate);
+        std::vector<int16_t> out;
+        uint64_t processed = 0;
+        auto start = std::chrono::steady_clock::now();
+        std::chrono::duration<double> elapsed {};
+        do {
+            out.clear();
+            mixer.Begin(frames);
+            for (const auto& channel : channels)
+                mixer.Add(channel.data(), frames, 1.0f / channel_count);
+            resampler.Process(mixer.GetData(), frames, out);
+            processed += frames;
+            elapsed = std::chrono::steady_clock::now() - start;
+        } while (elapsed.count() < min_seconds);
+        return processed / elapsed.count();
+    }
+}
+
+int main() {
+    const Conversion conversions[] = {
+        { "N64 AI 32000 -> 48000", 32000, 48000 },
+        { "N64 AI 44100 -> 48000", 44100, 48000 },
+        { "Gameboy 48000 -> 44100", 48000, 44100 },
+    };
+    for (const auto& conversion : conversions) {
+        double rate = measure(conversion);
+        std::cout << conversion.Name << ": " << rate / 1e6 << " M frames/s, "
+            << rate / conversion.InputRate << "x realtime" << std::endl;
+    }
+}
@@ -0,0 +1,165 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <lib/threaded_dispatch.hxx>
+
+// Measures instruction dispatch overhead in instructions per second, on 6502 and Chip8
+// interpreters that only implement the handful of opcodes their loops use, so the time
+// goes into fetch and dispatch rather than into instruction semantics.
+// Built twice, as TKPDispatchBench and as TKPDispatchBenchGoto with TKP_USE_COMPUTED_GOTO
+namespace {
+    constexpr double min_seconds = 0.25;
+
+    struct Cpu6502 {
+        #define CPU6502_HANDLERS(X) X(LDA_IMM) X(LDX_IMM) X(LDY_IMM) X(ADC_IMM) X(STA_ZP) \
+            X(TAX) X(TXA) X(INX) X(DEX) X(DEY) X(CLC) X(BNE) X(JMP) X(NOP) X(KIL)
+        enum Handler { CPU6502_HANDLERS(TKP_HANDLER_ENUM) };
+        #define CPU6502_OPCODES(X) X(0xA9, LDA_IMM) X(0xA2, LDX_IMM) X(0xA0, LDY_IMM) X(0x69, ADC_IMM) \
+            X(0x85, STA_ZP) X(0xAA, TAX) X(0x8A, TXA) X(0xE8, INX) X(0xCA, DEX) X(0x88, DEY) \
+            X(0x18, CLC) X(0xD0, BNE) X(0x4C, JMP) X(0xEA, NOP) X(0x1A, NOP) X(0x02, KIL)
+        static constexpr auto decode_table = TKPEmu::Tools::MakeDecodeTable<256>(KIL, { CPU6502_OPCODES(TKP_OPCODE_ENTRY) });
+        std::array<uint8_t, 0x10000> Memory {};
+        uint16_t PC = 0x200;
+        uint8_t A = 0, X = 0, Y = 0;
+        bool Z = false, N = false, C = false;
+        uint64_t Executed = 0;
+
+        uint8_t imm() { return Memory[PC++]; }
+        void set_zn(uint8_t value) {
+            Z = value == 0;
+            N = value & 0x80;
+        }
+        uint8_t next() {
+            Executed++;
+            return decode_table[Memory[PC++]];
+        }
+        void Run() {
+            TKP_DISPATCH_BEGIN(CPU6502_HANDLERS, next())
+            TKP_HANDLER(LDA_IMM) { A = imm(); set_zn(A); TKP_DISPATCH(next()); }
+            TKP_HANDLER(LDX_IMM) { X = imm(); set_zn(X); TKP_DISPATCH(next()); }
+            TKP_HANDLER(LDY_IMM) { Y = imm(); set_zn(Y); TKP_DISPATCH(next()); }
+            TKP_HANDLER(ADC_IMM) {
+                unsigned sum = A + imm() + C;
+                C = sum > 0xFF;
+                A = sum;
+                set_zn(A);
+                TKP_DISPATCH(next());
+            }
+            TKP_HANDLER(STA_ZP) { Memory[imm()] = A; TKP_DISPATCH(next()); }
+            TKP_HANDLER(TAX) { X = A; set_zn(X); TKP_DISPATCH(next()); }
+            TKP_HANDLER(TXA) { A = X; set_zn(A); TKP_DISPATCH(next()); }
+            TKP_HANDLER(INX) { set_zn(++X); TKP_DISPATCH(next()); }
+            TKP_HANDLER(DEX) { set_zn(--X); TKP_DISPATCH(next()); }
+            TKP_HANDLER(DEY) { set_zn(--Y); TKP_DISPATCH(next()); }
+            TKP_HANDLER(CLC) { C = false; TKP_DISPATCH(next()); }
+            TKP_HANDLER(BNE) {
+                int8_t offset = imm();
+                if (!Z)
+                    PC += offset;
+                TKP_DISPATCH(next());
+            }
+            TKP_HANDLER(JMP) {
+                PC = Memory[PC] | (Memory[PC + 1] << 8);
+                TKP_DISPATCH(next());
+            }
+            TKP_HANDLER(NOP) { TKP_DISPATCH(next()); }
+            TKP_HANDLER(KIL) { TKP_DISPATCH_EXIT; }
+            TKP_DISPATCH_END
+        }
+    };
+
+    // ldy #$40; outer: ldx #0; inner: txa; adc #3; sta $10; dex; bne inner; dey; bne outer; kil
+    constexpr uint8_t program_6502[] = {
+        0xA0, 0x40, 0xA2, 0x00, 0x8A, 0x69, 0x03, 0x85, 0x10, 0xCA, 0xD0, 0xF8, 0x88, 0xD0, 0xF3, 0x02,
+    };
+
+    struct Chip8Cpu {
+        #define CHIP8_HANDLERS(X) X(HALT) X(JP) X(SE) X(SNE) X(LD) X(ADD) X(LD_XY) X(ADD_XY) X(SUB_XY) X(LD_I)
+        enum Handler { CHIP8_HANDLERS(TKP_HANDLER_ENUM) };
+        // Decoded by the top nibble, 8xyN by the bottom one
+        #define CHIP8_OPCODES(X) X(0x1, JP) X(0x3, SE) X(0x4, SNE) X(0x6, LD) X(0x7, ADD) X(0xA, LD_I)
+        #define CHIP8_ALU_OPCODES(X) X(0x0, LD_XY) X(0x4, ADD_XY) X(0x5, SUB_XY)
+        static constexpr auto decode_table = TKPEmu::Tools::MakeDecodeTable<16>(HALT, { CHIP8_OPCODES(TKP_OPCODE_ENTRY) });
+        static constexpr auto alu_decode_table = TKPEmu::Tools::MakeDecodeTable<16>(HALT, { CHIP8_ALU_OPCODES(TKP_OPCODE_ENTRY) });
+        std::array<uint8_t, 0x1000> Memory {};
+        std::array<uint8_t, 16> V {};
+        uint16_t PC = 0x200;
+        uint16_t I = 0;
+        uint16_t Opcode = 0;
+        uint64_t Executed = 0;
+
+        uint8_t x() const { return (Opcode >> 8) & 0xF; }
+        uint8_t y() const { return (Opcode >> 4) & 0xF; }
+        uint8_t kk() const { return Opcode & 0xFF; }
+        uint8_t next() {
+            Executed++;
+            Opcode = (Memory[PC] << 8) | Memory[PC + 1];
+            PC = (PC + 2) & 0xFFF;
+            return (Opcode >> 12) == 0x8 ? alu_decode_table[Opcode & 0xF] : decode_table[Opcode >> 12];
+        }
+        void Run() {
+            TKP_DISPATCH_BEGIN(CHIP8_HANDLERS, next())
+            TKP_HANDLER(JP) { PC = Opcode & 0xFFF; TKP_DISPATCH(next()); }
+            TKP_HANDLER(SE) {
+                if (V[x()] == kk())
+                    PC = (PC + 2) & 0xFFF;
+                TKP_DISPATCH(next());
+            }
+            TKP_HANDLER(SNE) {
+                if (V[x()] != kk())
+                    PC = (PC + 2) & 0xFFF;
+                TKP_DISPATCH(next());
+            }
+            TKP_HANDLER(LD) { V[x()] = kk(); TKP_DISPATCH(next()); }
+            TKP_HANDLER(ADD) { V[x()] += kk(); TKP_DISPATCH(next()); }
+            TKP_HANDLER(LD_XY) { V[x()] = V[y()]; TKP_DISPATCH(next()); }
+            TKP_HANDLER(ADD_XY) {
+                unsigned sum = V[x()] + V[y()];
+                V[x()] = sum;
+                V[0xF] = sum > 0xFF;
+                TKP_DISPATCH(next());
+            }
+            TKP_HANDLER(SUB_XY) {
+                bool borrow = V[x()] < V[y()];
+                V[x()] -= V[y()];
+                V[0xF] = !borrow;
+                TKP_DISPATCH(next());
+            }
+            TKP_HANDLER(LD_I) { I = Opcode & 0xFFF; TKP_DISPATCH(next()); }
+            TKP_HANDLER(HALT) { TKP_DISPATCH_EXIT; }
+            TKP_DISPATCH_END
+        }
+    };
+
+    // ld v0, 0x40; outer: ld v1, 0; inner: add v1, 1; add v2, v1; se v1, 0; jp inner;
+    // add v0, 0xFF; se v0, 0; jp outer; halt
+    constexpr uint8_t program_chip8[] = {
+        0x60, 0x40, 0x61, 0x00, 0x71, 0x01, 0x82, 0x14, 0x31, 0x00, 0x12, 0x04,
+        0x70, 0xFF, 0x30, 0x00, 0x12, 0x02, 0x00, 0x00,
+    };
+
+    // Runs the program until at least min_seconds have passed and returns instructions per second
+    template<class Cpu, size_t Size>
+    double measure(const uint8_t (&program)[Size]) {
+        Cpu cpu;
+        uint64_t executed = 0;
+        auto start = std::chrono::steady_clock::now();
+        std::chrono::duration<double> elapsed {};
+        do {
+            cpu = Cpu();
+            std::copy(program, program + Size, cpu.Memory.begin() + 0x200);
+            cpu.Run();
+            executed += cpu.Executed;
+            elapsed = std::chrono::steady_clock::now() - start;
+        } while (elapsed.count() < min_seconds);
+        return executed / elapsed.count();
+    }
+}
+
+int main() {
+    std::cout << "Dispatch: " << (TKP_COMPUTED_GOTO ? "computed goto" : "switch") << "\n"
+        "6502: " << measure<Cpu6502>(program_6502) / 1e6 << " MIPS\n"
+        "Chip8: " << measure<Chip8Cpu>(program_chip8) / 1e6 << " MIPS" << std::endl;
+}
@@ -0,0 +1,189 @@
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <vector>
+#include <lib/page_table.hxx>
+
+// Measures Game Boy bus throughput with an MBC1 cartridge, decoding every access with an
+// address range switch against looking it up in a Tools::PageTable. Both buses replay the
+// same access stream, mostly ROM and WRAM with some HRAM/IO and the odd bank switch, and
+// must end up with the same checksum
+namespace {
+    constexpr int access_count = 1 << 20;
+    constexpr double min_seconds = 0.25;
+
+    struct Access {
+        uint16_t Address;
+        uint8_t Data;
+        bool Write;
+    };
+
+    struct Memory {
+        std::vector<uint8_t> Rom = std::vector<uint8_t>(0x100000);
+        std::array<uint8_t, 0x2000> Vram {};
+        std::array<uint8_t, 0x2000> Eram {};
+        std::array<uint8_t, 0x2000> Wram {};
+        std::array<uint8_t, 0x100> HighPage {};
+        bool RamEnabled = false;
+        uint8_t BankLow = 1;
+        uint8_t BankHigh = 0;
+        Memory() {
+            for (size_t i = 0; i < Rom.size(); i++)
+                Rom[i] = i * 7 + (i >> 14);
+        }
+        uint32_t rom_bank() const {
+            uint32_t bank = (BankLow ? BankLow : 1) | (BankHigh << 5);
+            return bank & 63;
+        }
+        // MBC registers, returns true if the banking changed
+        bool write_mbc(uint16_t address, uint8_t data) {
+            switch (address >> 13) {
+                case 0: RamEnabled = (data & 0xF) == 0xA; return true;
+                case 1: BankLow = data & 0x1F; return true;
+                case 2: BankHigh = data & 0x3; return true;
+            }
+            return false;
+        }
+    };
+
+    struct SwitchBus : Memory {
+        uint8_t Read(uint16_t address) {
+            switch (address >> 12) {
+                case 0x0: case 0x1: case 0x2: case 0x3:
+                    return Rom[address];
+                case 0x4: case 0x5: case 0x6: case 0x7:
+                    return Rom[rom_bank() * 0x4000 + (address - 0x4000)];
+                case 0x8: case 0x9:
+                    return Vram[address & 0x1FFF];
+                case 0xA: case 0xB:
+                    return RamEnabled ? Eram[address & 0x1FFF] : 0xFF;
+                case 0xC: case 0xD: case 0xE:
+                    return Wram[address & 0x1FFF];
+                case 0xF:
+                    if (address < 0xFE00)
+                        return Wram[address & 0x1FFF];
+                    return HighPage[address & 0xFF];
+            }
+            return 0xFF;
+        }
+        void Write(uint16_t address, uint8_t data) {
+            switch (address >> 12) {
+                case 0x0: case 0x1: case 0x2: case 0x3:
+                case 0x4: case 0x5: case 0x6: case 0x7:
+                    write_mbc(address, data);
+                    break;
+                case 0x8: case 0x9:
+                    Vram[address & 0x1FFF] = data;
+                    break;
+                case 0xA: case 0xB:
+                    if (RamEnabled)
+                        Eram[address & 0x1FFF] = data;
+                    break;
+                case 0xC: case 0xD: case 0xE:
+                    Wram[address & 0x1FFF] = data;
+                    break;
+                case 0xF:
+                    if (address < 0xFE00)
+                        Wram[address & 0x1FFF] = data;
+                    else
+                        HighPage[address & 0xFF] = data;
+                    break;
+            }
+        }
+    };
+
+    struct PagedBus : Memory {
+        TKPEmu::Tools::PageTable<PagedBus> Pages { *this };
+        PagedBus() {
+            Pages.MapRead(0x0000, 0x4000, Rom.data());
+            Pages.Map(0x8000, 0x2000, Vram.data());
+            Pages.Map(0xC000, 0x2000, Wram.data());
+            Pages.Map(0xE000, 0x1E00, Wram.data());
+            remap();
+        }
+        uint8_t Read(uint16_t address) { return Pages.Read(address); }
+        void Write(uint16_t address, uint8_t data) { Pages.Write(address, data); }
+        uint8_t IoRead(uint32_t address) {
+            if (address >= 0xFE00)
+                return HighPage[address & 0xFF];
+            return 0xFF;
+        }
+        void IoWrite(uint32_t address, uint8_t data) {
+            if (address >= 0xFE00)
+                HighPage[address & 0xFF] = data;
+            else if (address < 0x8000 && write_mbc(address, data))
+                remap();
+        }
+        void remap() {
+            Pages.MapRead(0x4000, 0x4000, Rom.data() + rom_bank() * 0x4000);
+            if (RamEnabled)
+                Pages.Map(0xA000, 0x2000, Eram.data());
+            else
+                Pages.Unmap(0xA000, 0x2000);
+        }
+    };
+
+    std::vector<Access> make_accesses() {
+        std::mt19937 rng(1234);
+        std::vector<Access> accesses(access_count);
+        for (auto& access : accesses) {
+            uint32_t kind = rng() % 1000;
+            uint16_t offset = rng();
+            access.Data = rng();
+            access.Write = false;
+            if (kind < 500) {
+                access.Address = offset & 0x7FFF;
+            } else if (kind < 900) {
+                access.Address = 0xC000 | (offset & 0x1FFF);
+                access.Write = kind & 1;
+            } else if (kind < 950) {
+                access.Address = 0xA000 | (offset & 0x1FFF);
+                access.Write = kind & 1;
+            } else if (kind < 999) {
+                access.Address = 0xFF00 | (offset & 0xFF);
+                access.Write = kind & 1;
+            } else {
+                access.Address = 0x2000 | (offset & 0x3FFF);
+                access.Write = true;
+            }
+        }
+        return accesses;
+    }
+
+    template<class Bus>
+    double measure(const std::vector<Access>& accesses, uint64_t& checksum) {
+        uint64_t count = 0;
+        std::chrono::duration<double> elapsed {};
+        do {
+            // Building the ROM isn't part of the measurement
+            Bus bus;
+            bus.Write(0x0000, 0x0A);
+            checksum = 0;
+            auto start = std::chrono::steady_clock::now();
+            for (const auto& access : accesses) {
+                if (access.Write)
+                    bus.Write(access.Address, access.Data);
+                else
+                    checksum = checksum * 31 + bus.Read(access.Address);
+            }
+            count += accesses.size();
+            elapsed += std::chrono::steady_clock::now() - start;
+        } while (elapsed.count() < min_seconds);
+        return count / elapsed.count();
+    }
+}
+
+int main() {
+    auto accesses = make_accesses();
+    uint64_t switch_checksum, paged_checksum;
+    double switch_rate = measure<SwitchBus>(accesses, switch_checksum);
+    double paged_rate = measure<PagedBus>(accesses, paged_checksum);
+    std::cout << "Switch: " << switch_rate / 1e6 << " M accesses/s\n"
+        "Page table: " << paged_rate / 1e6 << " M accesses/s" << std::endl;
+    if (switch_checksum != paged_checksum) {
+        std::cerr << "Checksum mismatch" << std::endl;
+        return 1;
+    }
+}
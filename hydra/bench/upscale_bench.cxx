@@ -0,0 +1,64 @@
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+#include <lib/upscale.hxx>
+
+// Measures frames per second of every upscale filter on a 256x240 frame, with the work
+// split across 1, 2 and 4 workers
+namespace {
+    constexpr int width = 256;
+    constexpr int height = 240;
+    constexpr double min_seconds = 0.25;
+
+    // Flat areas with diagonal edges and some noise, roughly what a game screen looks like
+    std::vector<uint32_t> make_frame() {
+        std::vector<uint32_t> frame(width * height);
+        uint32_t seed = 1;
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                seed = seed * 1103515245 + 12345;
+                uint32_t color = ((x + y) / 24) % 2 ? 0xFF3060C0 : 0xFFE0D0A0;
+                if ((seed >> 24) < 16)
+                    color = 0xFF000000 | (seed & 0xFFFFFF);
+                frame[y * width + x] = color;
+            }
+        }
+        return frame;
+    }
+
+    double measure(TKPEmu::Tools::Upscaler& upscaler, const std::vector<uint32_t>& frame, TKPEmu::Tools::UpscaleFilter filter) {
+        uint64_t frames = 0;
+        auto start = std::chrono::steady_clock::now();
+        std::chrono::duration<double> elapsed {};
+        do {
+            upscaler.Process(frame.data(), width, height, filter);
+            frames++;
+            elapsed = std::chrono::steady_clock::now() - start;
+        } while (elapsed.count() < min_seconds);
+        return frames / elapsed.count();
+    }
+}
+
+int main() {
+    using TKPEmu::Tools::UpscaleFilter;
+    const std::pair<const char*, UpscaleFilter> filters[] = {
+        { "Nearest 2x", UpscaleFilter::Nearest2x },
+        { "Nearest 3x", UpscaleFilter::Nearest3x },
+        { "Nearest 4x", UpscaleFilter::Nearest4x },
+        { "Scale2x", UpscaleFilter::Scale2x },
+        { "Scale3x", UpscaleFilter::Scale3x },
+        { "Scale4x", UpscaleFilter::Scale4x },
+        { "xBR 2x", UpscaleFilter::XBR2x },
+        { "xBR 4x", UpscaleFilter::XBR4x },
+    };
+    auto frame = make_frame();
+    for (unsigned workers : { 1u, 2u, 4u }) {
+        TKPEmu::Tools::WorkerPool pool(workers);
+        TKPEmu::Tools::Upscaler upscaler(pool);
+        std::cout << workers << " worker(s):" << std::endl;
+        for (const auto& [name, filter] : filters) {
+            std::cout << "  " << name << ": " << measure(upscaler, frame, filter) << " fps" << std::endl;
+        }
+    }
+}
@@ -0,0 +1,58 @@
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+#include <lib/vector_lanes.hxx>
+
+// Measures vector ops per second on a multiply-accumulate-and-clamp sequence like the ones
+// RSP vector opcodes are made of, once through the function pointer table and once with
+// the backend picked for the whole block
+namespace {
+    using namespace TKPEmu::Tools;
+    constexpr double min_seconds = 0.25;
+    constexpr int ops_per_block = 6;
+
+    template<class Block>
+    double measure(std::vector<VectorLanes>& regs, Block block) {
+        uint64_t blocks = 0;
+        auto start = std::chrono::steady_clock::now();
+        std::chrono::duration<double> elapsed {};
+        do {
+            for (int i = 0; i < 1024; i++)
+                block(regs[i % regs.size()], regs[(i + 1) % regs.size()]);
+            blocks += 1024;
+            elapsed = std::chrono::steady_clock::now() - start;
+        } while (elapsed.count() < min_seconds);
+        return blocks * ops_per_block / elapsed.count() / 1e6;
+    }
+}
+
+int main() {
+    std::vector<VectorLanes> regs(32);
+    for (size_t i = 0; i < regs.size(); i++)
+        for (int j = 0; j < 8; j++)
+            regs[i].Lanes[j] = static_cast<int16_t>(i * 977 + j * 131);
+    const VectorLaneOps& ops = GetVectorLaneOps();
+    double table = measure(regs, [&](VectorLanes& acc, const VectorLanes& b) {
+        VectorLanes low, high, mask;
+        ops.MulLow(low, acc, b);
+        ops.MulHigh(high, acc, b);
+        ops.AddSaturate(acc, acc, low);
+        ops.SubSaturate(high, high, b);
+        ops.CompareLess(mask, acc, high);
+        ops.Select(acc, mask, acc, high);
+    });
+    double block = measure(regs, [&](VectorLanes& acc, const VectorLanes& b) {
+        WithVectorBackend([&]<class Kernels>() {
+            VectorLanes low, high, mask;
+            Kernels::MulLow(low, acc, b);
+            Kernels::MulHigh(high, acc, b);
+            Kernels::AddSaturate(acc, acc, low);
+            Kernels::SubSaturate(high, high, b);
+            Kernels::CompareLess(mask, acc, high);
+            Kernels::Select(acc, mask, acc, high);
+        });
+    });
+    std::cout << "Function pointer per op: " << table << " Mops/s" << std::endl;
+    std::cout << "Backend per block: " << block << " Mops/s" << std::endl;
+}
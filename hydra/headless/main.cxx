@@ -0,0 +1,131 @@
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <include/emulator_factory.h>
+#include <include/error_factory.hxx>
+#include <include/input_movie.hxx>
+#include <include/console_colors.h>
+#include <lib/alloc_tracker.hxx>
+
+// Runs an emulator without a window on the calling thread, as fast as the core allows.
+// Used for benchmarks and for checking that a movie replays the same way every time
+namespace {
+    std::string read_file(const std::string& path) {
+        std::ifstream ifs(path);
+        if (!ifs.is_open())
+            throw ErrorFactory::generate_exception(__func__, __LINE__, "Could not open " + path);
+        std::stringstream buf;
+        buf << ifs.rdbuf();
+        return buf.str();
+    }
+
+    void setup_emulator_specific() {
+        std::string data_dir = TKP_DATA_DIR;
+        auto mappings_path = TKPEmu::EmulatorFactory::GetSavePath() + "mappings.json";
+        if (!std::filesystem::exists(mappings_path))
+            mappings_path = data_dir + "mappings.json";
+        auto constant_map = TKPEmu::EmulatorFactory::ParseEmulatorData(read_file(data_dir + "emulators.json"), read_file(mappings_path));
+        // Write default emulator options if they dont exist
+        for (auto& e : constant_map) {
+            auto path = TKPEmu::EmulatorFactory::GetSavePath() + e.SettingsFile;
+            if (!std::filesystem::exists(path))
+                std::filesystem::copy_file(data_dir + e.SettingsFile, path);
+        }
+        auto user_map = TKPEmu::EmulatorFactory::LoadEmulatorUserData(constant_map);
+        TKPEmu::EmulatorFactory::SetEmulatorData(std::move(constant_map));
+        TKPEmu::EmulatorFactory::SetEmulatorUserData(std::move(user_map));
+    }
+
+    void print_usage() {
+        std::cout << "Usage: TKPHeadless <rom> [--frames <count>] [--movie <path>] [--record <path>] [--fail-on-alloc]\n"
+            "  --frames  Number of frames to run, defaults to 600 or the length of the movie\n"
+            "  --movie   Movie file to play back\n"
+            "  --record  Record video and audio to <path>.y4m and <path>.wav\n"
+            "  --fail-on-alloc  Exit with an error if the emulator thread allocated after the warm-up,\n"
+            "                   needs a build with TKP_TRACK_ALLOCATIONS" << std::endl;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        print_usage();
+        return 1;
+    }
+    std::string rom_path = argv[1];
+    std::string movie_path;
+    std::string record_path;
+    bool fail_on_alloc = false;
+    uint64_t frames = 0;
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--frames" && i + 1 < argc) {
+            std::string count = argv[++i];
+            size_t parsed = 0;
+            try {
+                frames = std::stoull(count, &parsed);
+            } catch (std::exception&) {}
+            if (parsed == 0 || parsed != count.size() || count[0] == '-') {
+                print_usage();
+                return 1;
+            }
+        } else if (arg == "--movie" && i + 1 < argc) {
+            movie_path = argv[++i];
+        } else if (arg == "--record" && i + 1 < argc) {
+            record_path = argv[++i];
+        } else if (arg == "--fail-on-alloc") {
+            fail_on_alloc = true;
+        } else {
+            print_usage();
+            return 1;
+        }
+    }
+    if (fail_on_alloc && !TKPEmu::Tools::AllocationTracking) {
+        std::cerr << color_error << "--fail-on-alloc needs a build with TKP_TRACK_ALLOCATIONS" << color_reset << std::endl;
+        return 1;
+    }
+    try {
+        setup_emulator_specific();
+        auto type = TKPEmu::EmulatorFactory::GetEmulatorType(rom_path);
+        auto emulator = TKPEmu::EmulatorFactory::Create(type);
+        // None of the cores implement v_step yet, so tell the user instead of failing mid-run
+        if (!emulator->CanStep())
+            throw ErrorFactory::generate_exception(__func__, __LINE__, "The core for " + rom_path + " doesn't support headless runs yet (no v_step)");
+        if (!emulator->LoadFromFile(rom_path))
+            throw ErrorFactory::generate_exception(__func__, __LINE__, "Failed to open ROM");
+        if (!movie_path.empty()) {
+            auto movie = TKPEmu::InputMovie::Load(movie_path);
+            if (frames == 0)
+                frames = movie.GetLength();
+            emulator->StartPlayback(std::move(movie));
+        }
+        if (frames == 0)
+            frames = 600;
+        if (!record_path.empty())
+            emulator->StartAVRecording(record_path);
+        auto start = std::chrono::steady_clock::now();
+        uint64_t cycles = emulator->RunFrames(frames);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        if (!record_path.empty()) {
+            emulator->StopAVRecording();
+            auto stats = emulator->GetAVRecordingStats();
+            std::cout << "Recorded frames: " << stats.Frames << " (" << stats.Stalls << " stalls, " << stats.Dropped << " dropped)\n";
+        }
+        const auto& metrics = emulator->GetMetrics();
+        std::cout << "Frames: " << frames << "\n"
+            "Cycles: " << cycles << "\n"
+            "Idle cycles skipped: " << metrics.IdleSkippedCycles << " (" << metrics.IdleSkips << " skips)\n"
+            "Time: " << elapsed.count() << "s\n"
+            "FPS: " << frames / elapsed.count() << std::endl;
+        if (TKPEmu::Tools::AllocationTracking) {
+            std::cout << "Steady state allocations: " << metrics.SteadyStateAllocations << " in " << metrics.AllocatingFrames << " frames" << std::endl;
+            if (fail_on_alloc && metrics.AllocatingFrames != 0)
+                throw ErrorFactory::generate_exception(__func__, __LINE__, "The emulator thread allocated during steady state frames");
+        }
+    } catch (std::exception& ex) {
+        std::cerr << color_error << ex.what() << color_reset << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,64 @@
+#pragma once
+#ifndef TKP_AUDIO_RESAMPLER_H
+#define TKP_AUDIO_RESAMPLER_H
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Audio post-processing shared by the cores: channels are mixed into one stereo float
+// buffer per frame, which is then resampled from the system's rate (N64 AI rate, Game
+// Boy mixed output...) to the SDL device rate in one pass:
+//
+//     mixer.Begin(frames);
+//     mixer.Add(pulse, frames, 0.5f);
+//     mixer.Add(wave, frames, 0.25f);
+//     resampler.SetRatioAdjust(queue_is_low ? 1.002 : 1.0);
+//     resampler.Process(mixer.GetData(), frames, device_samples);
+//
+// Both use SSE on x86 and plain loops elsewhere
+namespace TKPEmu {
+    class AudioMixer {
+    public:
+        // Clears the mix to frames stereo frames of silence
+        void Begin(size_t frames);
+        // Adds interleaved stereo samples scaled by gain
+        void Add(const int16_t* samples, size_t frames, float gain);
+        void Add(const float* samples, size_t frames, float gain);
+        const float* GetData() const { return mix_.data(); }
+        size_t GetFrames() const { return mix_.size() / 2; }
+    private:
+        std::vector<float> mix_;
+    };
+
+    // Windowed sinc polyphase resampler for stereo audio. The cutoff follows the lower of
+    // the two rates so that downsampling doesn't alias
+    class AudioResampler {
+    public:
+        static constexpr int taps = 32;
+        static constexpr int phase_bits = 8;
+        static constexpr int phase_count = 1 << phase_bits;
+        AudioResampler(double input_rate, double output_rate);
+        // Recomputes the filter, for when the system changes its native rate
+        void SetRates(double input_rate, double output_rate);
+        // Scales the number of output samples produced per input sample, for small
+        // per frame corrections that keep the device queue from running dry or growing.
+        // Throws unless adjust is positive and leaves a usable step
+        void SetRatioAdjust(double adjust);
+        // Resamples frames interleaved stereo frames and appends the result to out, interleaved.
+        // Input that doesn't produce a full output sample yet is kept for the next call
+        void Process(const float* input, size_t frames, std::vector<int16_t>& out);
+        void Reset();
+    private:
+        double input_rate_;
+        double output_rate_;
+        // Input frames advanced per output frame, 32 bits of fraction
+        uint64_t step_;
+        // Position of the next output frame in the history, 32 bits of fraction
+        uint64_t position_ = 0;
+        std::vector<float> kernel_;
+        // Channels are kept apart so that the filter reads contiguous samples
+        std::vector<float> left_;
+        std::vector<float> right_;
+    };
+}
+#endif
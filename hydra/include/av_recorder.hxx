@@ -0,0 +1,92 @@
+#pragma once
+#ifndef TKP_AV_RECORDER_H
+#define TKP_AV_RECORDER_H
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace TKPEmu {
+    // Records gameplay to path.y4m and path.wav. The emulator thread only copies each frame
+    // and audio chunk into the next slot of a ring allocated by Start, the color conversion
+    // and file writes happen on a writer thread, so pushing doesn't allocate. Video is
+    // YUV 4:4:4 so no chroma is lost to subsampling, audio is 16-bit stereo PCM. Start, Stop
+    // and the Push functions are meant to be called from the emulator thread
+    class AVRecorder {
+    public:
+        struct Stats {
+            uint64_t Frames = 0;
+            uint64_t AudioFrames = 0;
+            // Frames whose size didn't match the recording and were left out
+            uint64_t Dropped = 0;
+            // Frames identical to the one before, written again without converting them
+            uint64_t Repeated = 0;
+            // Times the queue was full and the caller had to wait for the worker
+            uint64_t Stalls = 0;
+        };
+        // max_queued is how many frames and audio chunks may be waiting at once, a few
+        // frames of slack smooth over slow disk writes. Each slot holds a whole frame
+        AVRecorder(size_t max_queued = 8);
+        ~AVRecorder();
+        AVRecorder(const AVRecorder&) = delete;
+        AVRecorder& operator=(const AVRecorder&) = delete;
+        // Throws if the files can't be created or a recording is already running
+        void Start(const std::string& path, uint32_t width, uint32_t height, uint32_t fps = 60, uint32_t sample_rate = 48000);
+        // Writes everything still queued and finishes the WAV header
+        void Stop();
+        bool IsRecording() const { return recording_.load(std::memory_order_relaxed); }
+        // RGBA8888 pixels, rows top to bottom. If source_mutex is given it is held while the
+        // pixels are copied, but not while waiting for a free slot
+        void PushVideo(const uint8_t* rgba, uint32_t width, uint32_t height, std::mutex* source_mutex = nullptr);
+        // Interleaved stereo samples at the rate passed to Start
+        void PushAudio(const int16_t* samples, size_t frames);
+        Stats GetStats() const;
+    private:
+        struct Slot {
+            bool Video = false;
+            // Keeps its capacity between recordings
+            std::vector<uint8_t> Data;
+        };
+        // Waits for the writer if every slot is taken and returns the next one
+        Slot& acquire_slot();
+        // Hands the slot returned by acquire_slot to the writer
+        void submit_slot();
+        void wait_idle();
+        void writer_loop();
+        void write_frame(const std::vector<uint8_t>& rgba);
+        void write_audio(const std::vector<uint8_t>& samples);
+        std::thread writer_;
+        std::mutex mutex_;
+        std::condition_variable slot_filled_;
+        std::condition_variable slot_freed_;
+        std::vector<Slot> slots_;
+        // Slot the emulator thread fills next and slot the writer reads next
+        size_t write_index_ = 0;
+        size_t read_index_ = 0;
+        // Slots submitted and not yet written out, guarded by mutex_
+        size_t queued_ = 0;
+        bool stopping_ = false;
+        std::atomic_bool recording_ = false;
+        std::ofstream video_;
+        std::ofstream audio_;
+        uint32_t width_ = 0;
+        uint32_t height_ = 0;
+        uint32_t sample_rate_ = 0;
+        uint64_t audio_bytes_ = 0;
+        // Planes reused by the writer for every frame
+        std::vector<uint8_t> yuv_;
+        // Hash of the frame in yuv_, checked on the writer so the emulator thread only copies
+        uint64_t yuv_hash_ = 0;
+        bool yuv_valid_ = false;
+        std::atomic<uint64_t> frames_ = 0;
+        std::atomic<uint64_t> audio_frames_ = 0;
+        std::atomic<uint64_t> dropped_ = 0;
+        std::atomic<uint64_t> stalls_ = 0;
+        std::atomic<uint64_t> repeated_ = 0;
+    };
+}
+#endif
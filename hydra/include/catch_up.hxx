@@ -0,0 +1,51 @@
+#pragma once
+#ifndef TKP_CATCH_UP_H
+#define TKP_CATCH_UP_H
+#include <cstdint>
+#include "scheduler.hxx"
+
+namespace TKPEmu {
+    // Lets a component such as a PPU lag behind the CPU and only run when something could
+    // observe it, then run all the cycles it owes in one batch.
+    //
+    // Call Sync before every CPU access to the component's memory or registers (VRAM, OAM,
+    // STAT, PPUSTATUS...). Deadlines the CPU can observe without touching the component,
+    // like STAT or NMI interrupts, go on the Scheduler as events made by RegisterSyncEvent.
+    // Since every access sees the component exactly up to the access cycle, mid-scanline
+    // writes land on the same dot they would in lockstep.
+    //
+    // Component must provide void RunCycles(uint64_t from, uint64_t to), which advances
+    // it from cycle from to cycle to
+    template<class Component>
+    class CatchUp {
+    public:
+        CatchUp(Component& component) : component_(component) {}
+        void Sync(uint64_t cycle) {
+            if (cycle > synced_cycle_) {
+                component_.RunCycles(synced_cycle_, cycle);
+                synced_cycle_ = cycle;
+                sync_count_++;
+            }
+        }
+        // Registers an event that syncs the component when it fires and then calls callback,
+        // for the component's interrupts. Schedule it at the cycle of the next interrupt
+        Scheduler::EventId RegisterSyncEvent(Scheduler& scheduler, Scheduler::Callback callback) {
+            return scheduler.Register([this, &scheduler, callback = std::move(callback)](uint64_t late) {
+                Sync(scheduler.GetCycle() - late);
+                callback(late);
+            });
+        }
+        void Reset(uint64_t cycle = 0) {
+            synced_cycle_ = cycle;
+            sync_count_ = 0;
+        }
+        uint64_t GetSyncedCycle() const { return synced_cycle_; }
+        // Number of batches run, for comparing against the cycles they covered
+        uint64_t GetSyncCount() const { return sync_count_; }
+    private:
+        Component& component_;
+        uint64_t synced_cycle_ = 0;
+        uint64_t sync_count_ = 0;
+    };
+}
+#endif
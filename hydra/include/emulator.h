@@ -11,9 +11,16 @@
 #include <any>
 #include <fstream>
 #include <bitset>
+#include <algorithm>
 #include "emulator_data.hxx"
 #include "emulator_user_data.hxx"
+#include "input_movie.hxx"
+#include "input_map.hxx"
+#include "scheduler.hxx"
+#include "av_recorder.hxx"
 #include "../lib/messagequeue.hxx"
+#include "../lib/emulator_control.hxx"
+#include "../lib/alloc_tracker.hxx"
 
 namespace {
 	bool always_false_ = false;
@@ -35,6 +42,19 @@ namespace {
 	bool poll_uncommon_request(const Request& request) override
 
 namespace TKPEmu {
+	// Counters for benchmarks and the headless runner, updated by the emulator thread
+	struct EmulatorMetrics {
+		// Cycles jumped over while the CPU was halted or spinning in an idle loop
+		std::atomic<uint64_t> IdleSkippedCycles = 0;
+		std::atomic<uint64_t> IdleSkips = 0;
+		// Frames handed to the frontend, and the ones it didn't redraw because nothing changed
+		std::atomic<uint64_t> PresentedFrames = 0;
+		std::atomic<uint64_t> SkippedFrames = 0;
+		// Only counted when built with TKP_TRACK_ALLOCATIONS. Heap allocations the emulator
+		// thread made in frames after the warm-up, and how many of those frames allocated
+		std::atomic<uint64_t> SteadyStateAllocations = 0;
+		std::atomic<uint64_t> AllocatingFrames = 0;
+	};
 	class Emulator {
 	public:
 		Emulator() {};
@@ -45,14 +65,71 @@ namespace TKPEmu {
 		std::atomic_bool Paused = false;
 		std::atomic_bool Step = false;
 		std::atomic_bool Loaded = false;
+		// Single word that the emulator thread sleeps on while paused.
+		// Stopped, Paused and Step are still kept in sync for cores that use them
+		Tools::EmulatorControl Control;
+		// State of the emulated buttons, updated on every KeyDown and KeyUp
+		InputMap Input;
 		bool SkipBoot = false;
 		bool FastMode = false;
 		void Start();
 		void Reset();
-		virtual void HandleKeyDown(uint32_t keycode);
-		virtual void HandleKeyUp(uint32_t keycode);
+		// Pause, Resume and StepInstruction also drive the Paused and Step flags that the
+		// threaded cores wait on
+		void Pause();
+		void Resume();
+		void StepInstruction();
+		// These only take effect in cores that call on_instruction, on_scanline and on_frame
+		// and wait in Control.Wait(). No threaded core does that yet, so for them these
+		// do nothing; RunFrames, RunCycles and RunUntil are the working alternatives
+		void StepScanline();
+		void StepFrame();
+		void RunToCycle(uint64_t cycle);
+		bool IsPaused() const { return Control.IsPaused(); }
+		// Synchronous alternatives to Start for tests and headless runs. They execute on the
+		// caller's thread and don't poll the message queue. Each returns the cycles it ran,
+		// which may overshoot the target by at most one instruction
+		uint64_t RunFrames(uint64_t frames);
+		uint64_t RunCycles(uint64_t cycles);
+		// Runs until predicate returns true, checked after every instruction, or until
+		// max_cycles have passed. Returns whether the predicate was satisfied
+		bool RunUntil(const std::function<bool()>& predicate, uint64_t max_cycles = UINT64_MAX);
+		// Whether the core implements v_step, which the Run functions above need. Cores that
+		// override v_step must override this to return true
+		virtual bool CanStep() const { return false; }
+		uint64_t GetCycleCount() const { return cycle_count_; }
+		uint64_t GetFrameCount() const { return frame_count_; }
+		const EmulatorMetrics& GetMetrics() const { return metrics_; }
+		// Called on every key event for cores that handle keys themselves
+		// instead of reading the button state from Input
+		virtual void HandleKeyDown(uint32_t) {};
+		virtual void HandleKeyUp(uint32_t) {};
+		// Entry points for host input, keycode is a Qt key or an InputMap::ControllerKey. While a movie is being recorded inputs are deferred
+		// to the next frame boundary so that a playback can apply them at the exact same point
+		void KeyDown(uint32_t keycode);
+		void KeyUp(uint32_t keycode);
+		// These reset the emulator and must be called from the emulator thread, or before
+		// it starts. From the UI use the COMMON_START_RECORDING and COMMON_STOP_RECORDING requests
+		void StartRecording();
+		void StopRecording(const std::string& path);
+		// Host input is ignored until the movie ends
+		void StartPlayback(InputMovie movie);
+		bool IsRecording() const { return recording_.load(); }
+		bool IsPlayingBack() const { return playing_back_.load(); }
+		// Records video and audio to path.y4m and path.wav until stopped, creating the directory
+		// if needed. Same threading rules as StartRecording, from the UI use the
+		// COMMON_START_AV_RECORDING and COMMON_STOP_AV_RECORDING requests
+		void StartAVRecording(const std::string& path, uint32_t fps = 60, uint32_t sample_rate = 48000);
+		void StopAVRecording();
+		bool IsAVRecording() const { return av_recording_.load(); }
+		AVRecorder::Stats GetAVRecordingStats() const;
 		bool LoadFromFile(std::string path);
+		// Copies the screen and returns, the PNG is encoded and saved on a background thread
 		void Screenshot(std::string filename, std::string directory = {});
+		// Blocks until every screenshot taken so far has been written
+		static void WaitForScreenshots();
+		// Signals the emulator thread to stop without waiting for it
+		void Close();
 		void CloseAndWait();
 		int GetWidth() { return width_; }
 		int GetHeight() { return height_; }
@@ -61,6 +138,11 @@ namespace TKPEmu {
 		virtual void* GetScreenData();
 		virtual bool& IsReadyToDraw() { return always_false_; };
 		virtual bool& IsResized() { return always_false_; };
+		// Called by the frontend with DrawMutex held once IsReadyToDraw is set. Clears
+		// IsReadyToDraw and returns whether the frame differs from the last one presented, so
+		// that unchanged frames can skip conversion, scaling and upload. Pass force when the
+		// frame has to be redrawn anyway, for example after the window was resized
+		bool ConsumeFrame(bool force = false);
 		std::mutex DrawMutex;
 		std::mutex FrameMutex;
 		std::mutex ThreadStartedMutex;
@@ -71,17 +153,100 @@ namespace TKPEmu {
 		// This function should only be ran if you're sure there's
 		// at least 1 request
 		bool poll_request(const Request& request);
+		// Called by the emulator thread at instruction, scanline and frame boundaries
+		// so that stepping and run-to-cycle can pause it there
+		void on_instruction(uint32_t cycles) {
+			cycle_count_ += cycles;
+			Control.OnInstruction(cycle_count_);
+		}
+		void on_scanline() {
+			Control.OnScanline();
+		}
+		void on_frame() {
+			frame_count_++;
+			if (recording_.load(std::memory_order_relaxed) || playing_back_.load(std::memory_order_relaxed)) [[unlikely]]
+				apply_movie_inputs();
+			if (av_recording_.load(std::memory_order_relaxed)) [[unlikely]]
+				av_recorder_->PushVideo(static_cast<const uint8_t*>(GetScreenData()), width_, height_, &DrawMutex);
+			if constexpr (Tools::AllocationTracking) {
+				if (uint64_t allocations = allocation_monitor_.MarkFrame()) {
+					metrics_.SteadyStateAllocations.fetch_add(allocations, std::memory_order_relaxed);
+					metrics_.AllocatingFrames.fetch_add(1, std::memory_order_relaxed);
+				}
+			}
+			Control.OnFrame();
+		}
+		// Cores hand their final mixed output here, interleaved stereo at the rate the
+		// recording was started with. Does nothing unless a video is being recorded
+		void push_audio(const int16_t* samples, size_t frames) {
+			if (av_recording_.load(std::memory_order_relaxed)) [[unlikely]]
+				av_recorder_->PushAudio(samples, frames);
+		}
+		// For cores that know when they touched the framebuffer. Once called, ConsumeFrame
+		// trusts these instead of hashing the screen
+		void set_frame_changed(bool changed) {
+			dirty_tracking_.store(true, std::memory_order_relaxed);
+			if (changed)
+				frame_changed_.store(true, std::memory_order_relaxed);
+		}
+		// Skips ahead to the next scheduled event, for when the CPU is halted until an
+		// interrupt or an IdleLoopDetector found an idle loop. For loops pass the loop length
+		// so that only whole iterations are skipped. Never skips past a RunToCycle target.
+		// Returns the number of cycles skipped
+		uint64_t skip_idle(Scheduler& scheduler, uint64_t loop_cycles = 1) {
+			uint64_t next = scheduler.GetNextEventCycle();
+			if (next == UINT64_MAX || next <= scheduler.GetCycle() || loop_cycles == 0)
+				return 0;
+			uint64_t span = next - scheduler.GetCycle();
+			uint64_t target = Control.GetTargetCycle();
+			if (target != UINT64_MAX)
+				span = std::min(span, target > cycle_count_ ? target - cycle_count_ : 0);
+			uint64_t skipped = span / loop_cycles * loop_cycles;
+			if (skipped == 0)
+				return 0;
+			scheduler.AddCycles(skipped);
+			cycle_count_ += skipped;
+			Control.OnInstruction(cycle_count_);
+			metrics_.IdleSkippedCycles.fetch_add(skipped, std::memory_order_relaxed);
+			metrics_.IdleSkips.fetch_add(1, std::memory_order_relaxed);
+			return skipped;
+		}
+		uint64_t cycle_count_ = 0;
+		uint64_t frame_count_ = 0;
+		EmulatorMetrics metrics_;
 		std::unique_ptr<std::ofstream> log_file_ptr_;
 		std::bitset<64> log_flags_;
 		bool logging_ = false;
 	private:
 		virtual void v_extra_close() {};
 		virtual void v_log() {};
+		// Executes a single instruction. Must call on_instruction and on_frame
+		virtual void v_step();
 		virtual void start();
 		virtual void reset();
 		virtual bool load_file(std::string);
 		virtual bool poll_uncommon_request(const Request& request) = 0;
-		int width_, height_;
+		void apply_movie_inputs();
+		void throw_if_cant_step() const;
+		void host_input(uint32_t keycode, bool down);
+		void apply_input(uint32_t keycode, bool down);
+		int width_ = 0, height_ = 0;
+		std::atomic_bool recording_ = false;
+		std::atomic_bool playing_back_ = false;
+		std::atomic_bool av_recording_ = false;
+		std::atomic_bool dirty_tracking_ = false;
+		std::atomic_bool frame_changed_ = false;
+		// Hash of the last presented frame, only touched under DrawMutex
+		uint64_t presented_hash_ = 0;
+		bool presented_any_ = false;
+		// Created on the first recording so that emulators that never record don't keep a thread around
+		std::unique_ptr<AVRecorder> av_recorder_;
+		Tools::FrameAllocationMonitor allocation_monitor_;
+		std::mutex input_mutex_;
+		std::vector<InputEvent> pending_inputs_;
+		InputMovie movie_;
+		size_t movie_index_ = 0;
+		uint64_t movie_start_frame_ = 0;
 	};
 }
 #endif
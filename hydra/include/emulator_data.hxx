@@ -13,6 +13,8 @@ using json = nlohmann::json;
 struct KeyMappings {
     std::vector<std::string> KeyNames;
     std::vector<uint32_t> KeyValues;
+    // SDL_GameControllerButton for each key name, optional
+    std::vector<uint32_t> ControllerValues;
 };
 struct EmulatorData {
     std::string Name;
@@ -27,6 +27,10 @@ namespace TKPEmu {
         static EmuType GetEmulatorType(std::filesystem::path path);
         static const std::vector<std::string>& GetSupportedExtensions();
         static KeyMappings GetMappings(TKPEmu::EmuType type);
+        // Parses the contents of emulators.json and mappings.json
+        static EmulatorDataMap ParseEmulatorData(const std::string& emulators_json, const std::string& mappings_json);
+        // Reads the options file of every emulator from the save path
+        static EmulatorUserDataMap LoadEmulatorUserData(const EmulatorDataMap& data);
         static void SetEmulatorData(EmulatorDataMap map);
         static const EmulatorDataMap& GetEmulatorData() { return emulator_data_; }
         static void SetEmulatorUserData(EmulatorUserDataMap map);
@@ -0,0 +1,42 @@
+#pragma once
+#ifndef TKP_EMULATOR_RUNNER_H
+#define TKP_EMULATOR_RUNNER_H
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <thread>
+#include "emulator.h"
+
+namespace TKPEmu {
+    // Owns the thread an emulator runs on. The runner holds a reference to the emulator
+    // for as long as the thread is alive and joins it on Stop, so the old emulator can't
+    // be destroyed while its thread is still using it (for example when switching ROMs)
+    class EmulatorRunner {
+    public:
+        // How long Stop waits for the emulator thread before giving up on it
+        static constexpr std::chrono::milliseconds default_stop_timeout { 2000 };
+        EmulatorRunner() = default;
+        ~EmulatorRunner();
+        EmulatorRunner(const EmulatorRunner&) = delete;
+        EmulatorRunner& operator=(const EmulatorRunner&) = delete;
+        // Stops any emulator that is currently running and starts this one on a new thread
+        void Start(std::shared_ptr<Emulator> emulator);
+        // Signals the emulator to stop and waits up to timeout for its thread to exit.
+        // A core stuck somewhere that doesn't check for Close is logged and its thread is
+        // detached, it keeps its own reference to the emulator so nothing is freed under
+        // it. Returns false in that case
+        bool Stop(std::chrono::milliseconds timeout = default_stop_timeout);
+        // Waits for the emulator thread to exit on its own
+        void Join();
+        bool IsRunning() const { return running_ && running_->load(); }
+    private:
+        std::shared_ptr<Emulator> emulator_;
+        std::thread thread_;
+        // Ready once the thread has finished, shared with it so a detached thread never
+        // touches the runner
+        std::future<void> exited_;
+        std::shared_ptr<std::atomic_bool> running_;
+    };
+}
+#endif
@@ -0,0 +1,72 @@
+#pragma once
+#ifndef TKP_GB_SCANLINE_RENDERER_H
+#define TKP_GB_SCANLINE_RENDERER_H
+#include <array>
+#include <cstdint>
+#include <lib/tile_decode.hxx>
+
+namespace TKPEmu::Gameboy {
+    // PPU registers as they were at the start of mode 3
+    struct ScanlineRegisters {
+        uint8_t LCDC = 0;
+        uint8_t LY = 0;
+        uint8_t SCY = 0;
+        uint8_t SCX = 0;
+        uint8_t WY = 0;
+        uint8_t WX = 0;
+        uint8_t BGP = 0;
+        uint8_t OBP0 = 0;
+        uint8_t OBP1 = 0;
+        // Internal window line counter, only increments on lines that drew the window
+        uint8_t WindowLine = 0;
+    };
+
+    struct OamEntry {
+        uint8_t Y;
+        uint8_t X;
+        uint8_t Tile;
+        uint8_t Flags;
+    };
+
+    // Renders a whole DMG scanline at once: tile rows are decoded with the SIMD paths in
+    // Tools::TileDecodeOps, then BG, window and sprite priority are resolved for all 160
+    // pixels, instead of running the pixel FIFO once per dot.
+    //
+    // That is only exact when nothing the line depends on changes during mode 3. The core
+    // calls BeginLine when a line starts and OnMidLineWrite before any write to LCDC, SCX,
+    // SCY, WX, WY, the palettes, VRAM or OAM made during mode 3, while the old values are
+    // still visible. The first such write of a line returns true: the core then runs its
+    // dot accurate path from the start of the line up to the current dot and stays on it
+    // until the line ends. Lines that reach the end of mode 3 with CanBatch still true are
+    // rendered with RenderLine
+    class ScanlineRenderer {
+    public:
+        static constexpr int width = 160;
+        void BeginLine() {
+            mid_line_write_ = false;
+        }
+        bool OnMidLineWrite() {
+            bool first = !mid_line_write_;
+            mid_line_write_ = true;
+            return first;
+        }
+        bool CanBatch() const { return !mid_line_write_; }
+        // Writes the shade (0-3, after the palettes) of every pixel of the line to out.
+        // vram is the 8KB at 0x8000 and oam the 40 sprite entries. Returns true if the
+        // window was drawn, in which case the window line counter has to be incremented
+        bool RenderLine(const uint8_t* vram, const OamEntry* oam, const ScanlineRegisters& regs, uint8_t* out);
+    private:
+        // Decodes tile_count tiles from the tile map row at map_offset, starting at column
+        // first_column, into pixels_
+        void decode_map_row(const uint8_t* vram, uint16_t map_offset, int first_column, int tile_count, int fine_y, bool unsigned_tiles);
+        const Tools::TileDecodeOps& ops_ = Tools::GetTileDecodeOps();
+        // 21 tiles cover 160 pixels at any fine scroll
+        std::array<uint8_t, 21 * 2> rows_ {};
+        std::array<uint8_t, 21 * 8> pixels_ {};
+        std::array<uint8_t, width> bg_ {};
+        std::array<uint8_t, width> obj_color_ {};
+        std::array<uint8_t, width> obj_flags_ {};
+        bool mid_line_write_ = false;
+    };
+}
+#endif
@@ -0,0 +1,56 @@
+#pragma once
+#ifndef TKP_IDLE_LOOP_DETECTOR_H
+#define TKP_IDLE_LOOP_DETECTOR_H
+#include <cstdint>
+
+namespace TKPEmu {
+    // Recognizes short loops that poll a register while waiting for something external,
+    // such as LY or PPUSTATUS during vblank waits.
+    //
+    // The core reports every taken branch with a hash of the CPU state it can see (registers
+    // and flags) and every write. If the same loop runs twice in a row, is short, wrote
+    // nothing and ended both iterations in the same state, every following iteration will
+    // be identical until something outside the CPU changes. As long as those changes only
+    // happen on scheduled events, whole iterations can be skipped up to the next event.
+    // Skip a multiple of GetLoopCycles so the loop still sees the change on the same cycle
+    class IdleLoopDetector {
+    public:
+        static constexpr uint32_t max_loop_instructions = 16;
+        void OnInstruction(uint32_t cycles) {
+            instructions_++;
+            cycles_ += cycles;
+        }
+        // Any write to memory or to a register outside the CPU
+        void OnWrite() {
+            wrote_ = true;
+        }
+        // Returns true if the loop branching to target is idle
+        bool OnBranch(uint32_t target, uint64_t state_hash) {
+            bool idle = target == loop_target_ && state_hash == loop_state_ &&
+                !wrote_ && instructions_ <= max_loop_instructions;
+            loop_target_ = target;
+            loop_state_ = state_hash;
+            loop_cycles_ = cycles_;
+            wrote_ = false;
+            instructions_ = 0;
+            cycles_ = 0;
+            return idle;
+        }
+        // Cycles taken by one iteration of the last loop, including the branch
+        uint32_t GetLoopCycles() const { return loop_cycles_; }
+        void Reset() {
+            loop_target_ = UINT32_MAX;
+            wrote_ = false;
+            instructions_ = 0;
+            cycles_ = 0;
+        }
+    private:
+        uint32_t loop_target_ = UINT32_MAX;
+        uint64_t loop_state_ = 0;
+        uint32_t loop_cycles_ = 0;
+        uint32_t instructions_ = 0;
+        uint32_t cycles_ = 0;
+        bool wrote_ = false;
+    };
+}
+#endif
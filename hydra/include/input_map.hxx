@@ -0,0 +1,97 @@
+#pragma once
+#ifndef TKP_INPUT_MAP_H
+#define TKP_INPUT_MAP_H
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include "emulator_data.hxx"
+
+namespace TKPEmu {
+    // Host key to emulated button table, built once from KeyMappings so that handling
+    // an input is a single indexed load instead of a search through the key names.
+    // Button n of an emulator is the nth entry of its KeyNames, bit n of the state.
+    //
+    // Host keys are Qt key codes. Game controller buttons share the same key space
+    // through ControllerKey so they can go everywhere a key can, movies included
+    class InputMap {
+    public:
+        InputMap() { table_.fill(0); }
+        InputMap(const InputMap&) = delete;
+        InputMap& operator=(const InputMap&) = delete;
+        void Load(const KeyMappings& mappings);
+        static constexpr uint32_t ControllerKey(uint32_t sdl_button) {
+            return controller_key_base | sdl_button;
+        }
+        uint32_t GetKeyButtons(uint32_t key) const {
+            return table_[get_index(key)];
+        }
+        // A button stays held while any key mapped to it is held, so releasing the keyboard
+        // key doesn't release a pad button that is still down. Repeated presses of a held
+        // key are ignored. KeyDown and KeyUp must not run concurrently with each other,
+        // Emulator serializes them under its input lock
+        void KeyDown(uint32_t key) {
+            size_t index = get_index(key);
+            if (held_keys_[index])
+                return;
+            held_keys_[index] = true;
+            uint32_t buttons = table_[index];
+            uint32_t pressed = 0;
+            for (; buttons; buttons &= buttons - 1) {
+                int button = std::countr_zero(buttons);
+                if (hold_counts_[button]++ == 0)
+                    pressed |= 1u << button;
+            }
+            state_.fetch_or(pressed, std::memory_order_release);
+        }
+        void KeyUp(uint32_t key) {
+            size_t index = get_index(key);
+            if (!held_keys_[index])
+                return;
+            held_keys_[index] = false;
+            uint32_t buttons = table_[index];
+            uint32_t released = 0;
+            for (; buttons; buttons &= buttons - 1) {
+                int button = std::countr_zero(buttons);
+                if (--hold_counts_[button] == 0)
+                    released |= 1u << button;
+            }
+            state_.fetch_and(~released, std::memory_order_release);
+        }
+        // Bitmask of the buttons that are currently held, safe to read from any thread.
+        // Meant to be read by cores once per frame. The cores in this tree don't read it
+        // yet and still get every key through HandleKeyDown and HandleKeyUp
+        uint32_t GetButtons() const {
+            return state_.load(std::memory_order_acquire);
+        }
+    private:
+        static constexpr uint32_t qt_special_key_base = 0x01000000;
+        static constexpr uint32_t controller_key_base = 0x02000000;
+        static constexpr uint32_t controller_button_count = 0x20;
+        // Latin-1 keys, Qt special keys (arrows, enter, ...) and controller buttons
+        // each get their own region. The last entry is always zero and catches
+        // every key that can't be mapped
+        static constexpr size_t special_offset = 0x100;
+        static constexpr size_t controller_offset = 0x200;
+        static constexpr size_t unmapped_index = controller_offset + controller_button_count;
+        static size_t get_index(uint32_t key) {
+            if (key < special_offset)
+                return key;
+            uint32_t low = key & 0x00FFFFFF;
+            switch (key & 0xFF000000) {
+                case qt_special_key_base:
+                    return low < special_offset ? special_offset + low : unmapped_index;
+                case controller_key_base:
+                    return low < controller_button_count ? controller_offset + low : unmapped_index;
+                default:
+                    return unmapped_index;
+            }
+        }
+        std::array<uint32_t, unmapped_index + 1> table_;
+        std::array<bool, unmapped_index + 1> held_keys_ {};
+        // Number of held keys mapped to each button
+        std::array<uint8_t, 32> hold_counts_ {};
+        std::atomic<uint32_t> state_ = 0;
+    };
+}
+#endif
@@ -0,0 +1,36 @@
+#pragma once
+#ifndef TKP_INPUT_MOVIE_H
+#define TKP_INPUT_MOVIE_H
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace TKPEmu {
+    struct InputEvent {
+        // Frame relative to the start of the recording on which the input is applied
+        uint64_t Frame;
+        uint32_t Key;
+        bool Down;
+    };
+    // A recording of every key press and release, stamped with the emulated frame it
+    // was applied on. Inputs are only ever applied on frame boundaries both while
+    // recording and while playing back, so a replay feeds the core the exact same inputs
+    //
+    // File format, all integers are unsigned LEB128:
+    // "TKPM", version byte, length in frames, event count,
+    // then for each event: frames since the previous event, key << 1 | down
+    class InputMovie {
+    public:
+        InputMovie() = default;
+        static InputMovie Load(const std::string& path);
+        void Save(const std::string& path) const;
+        void Record(uint64_t frame, uint32_t key, bool down);
+        const std::vector<InputEvent>& GetEvents() const { return events_; }
+        uint64_t GetLength() const { return length_; }
+        void SetLength(uint64_t length) { length_ = length; }
+    private:
+        std::vector<InputEvent> events_;
+        uint64_t length_ = 0;
+    };
+}
+#endif
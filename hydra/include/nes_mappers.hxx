@@ -0,0 +1,248 @@
+#pragma once
+#ifndef TKP_NES_MAPPERS_H
+#define TKP_NES_MAPPERS_H
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <lib/bank_map.hxx>
+#include "error_factory.hxx"
+
+// Cartridge mappers as concrete types instead of a mapper number checked on every access.
+// The core instantiates its CPU and PPU read paths once per mapper through VisitMapper:
+//
+//     TKPEmu::NES::VisitMapper(header.Mapper, cartridge, [&](auto& mapper) { run(mapper); });
+//
+// so mapper.CpuRead and mapper.PpuRead inline into the core. Bank switching writes go through
+// CpuWrite, which recomputes the BankMap pointers once instead of on every read
+namespace TKPEmu::NES {
+    enum class Mirroring {
+        Horizontal,
+        Vertical,
+        SingleScreenLow,
+        SingleScreenHigh,
+    };
+
+    struct Cartridge {
+        std::vector<uint8_t> Prg;
+        // 8KB of CHR RAM when the cartridge has no CHR ROM
+        std::vector<uint8_t> Chr;
+        bool ChrRam = false;
+        Mirroring Mirror = Mirroring::Horizontal;
+    };
+
+    // Common read and write paths: $6000-$7FFF PRG RAM, $8000-$FFFF PRG in 8KB windows
+    // and $0000-$1FFF CHR in 1KB windows. Mappers hide CpuWrite to handle their registers
+    class MapperBase {
+    public:
+        MapperBase(Cartridge& cartridge) : cartridge_(cartridge), mirroring_(cartridge.Mirror) {
+            if (cartridge.Prg.empty() || cartridge.Prg.size() % prg_window != 0)
+                throw ErrorFactory::generate_exception(__func__, __LINE__, "Bad PRG ROM size");
+            if (cartridge.Chr.empty() || cartridge.Chr.size() % chr_window != 0)
+                throw ErrorFactory::generate_exception(__func__, __LINE__, "Bad CHR size");
+        }
+        uint8_t CpuRead(uint16_t address) const {
+            if (address & 0x8000) [[likely]]
+                return prg_.Read(address & 0x7FFF);
+            if (address >= 0x6000)
+                return prg_ram_[address & 0x1FFF];
+            return 0;
+        }
+        void CpuWrite(uint16_t address, uint8_t data) {
+            if (address >= 0x6000 && address < 0x8000)
+                prg_ram_[address & 0x1FFF] = data;
+        }
+        uint8_t PpuRead(uint16_t address) const {
+            return chr_.Read(address & 0x1FFF);
+        }
+        void PpuWrite(uint16_t address, uint8_t data) {
+            if (cartridge_.ChrRam)
+                chr_.Write(address & 0x1FFF, data);
+        }
+        Mirroring GetMirroring() const { return mirroring_; }
+    protected:
+        static constexpr uint32_t prg_window = 0x2000;
+        static constexpr uint32_t chr_window = 0x400;
+        // Maps bank number bank of size bytes at address. Each window wraps around on its own,
+        // so banks past the end of the ROM and ROMs smaller than the bank are mirrored
+        void map_prg(uint16_t address, uint32_t size, uint32_t bank) {
+            for (uint32_t i = 0; i < size / prg_window; i++) {
+                uint32_t offset = (bank * size + i * prg_window) % cartridge_.Prg.size();
+                prg_.Map((address & 0x7FFF) / prg_window + i, 1, cartridge_.Prg.data() + offset);
+            }
+        }
+        void map_chr(uint16_t address, uint32_t size, uint32_t bank) {
+            for (uint32_t i = 0; i < size / chr_window; i++) {
+                uint32_t offset = (bank * size + i * chr_window) % cartridge_.Chr.size();
+                chr_.Map(address / chr_window + i, 1, cartridge_.Chr.data() + offset);
+            }
+        }
+        // Throws if the ROM is bigger than the board's banking registers can reach
+        void check_sizes(uint32_t max_prg, uint32_t max_chr) const {
+            if (cartridge_.Prg.size() > max_prg)
+                throw ErrorFactory::generate_exception(__func__, __LINE__, "PRG ROM too big for the mapper");
+            if (cartridge_.Chr.size() > max_chr)
+                throw ErrorFactory::generate_exception(__func__, __LINE__, "CHR too big for the mapper");
+        }
+        uint32_t prg_bank_count(uint32_t size) const { return cartridge_.Prg.size() / size; }
+        Cartridge& cartridge_;
+        Mirroring mirroring_;
+    private:
+        Tools::BankMap<13, 4> prg_;
+        Tools::BankMap<10, 8> chr_;
+        std::vector<uint8_t> prg_ram_ = std::vector<uint8_t>(0x2000);
+    };
+
+    // Mapper 0, 16KB ROMs are mirrored at $C000
+    class NROM : public MapperBase {
+    public:
+        static constexpr int Number = 0;
+        NROM(Cartridge& cartridge) : MapperBase(cartridge) {
+            check_sizes(0x8000, 0x2000);
+            map_prg(0x8000, 0x4000, 0);
+            map_prg(0xC000, 0x4000, 1);
+            map_chr(0x0000, 0x2000, 0);
+        }
+    };
+
+    // Mapper 1, registers are written a bit at a time through a serial port
+    class MMC1 : public MapperBase {
+    public:
+        static constexpr int Number = 1;
+        MMC1(Cartridge& cartridge) : MapperBase(cartridge) {
+            // 512KB SUROM boards take the top PRG bit from the CHR registers, which isn't emulated
+            check_sizes(0x40000, 0x20000);
+            update_banks();
+        }
+        void CpuWrite(uint16_t address, uint8_t data) {
+            if (!(address & 0x8000)) {
+                MapperBase::CpuWrite(address, data);
+                return;
+            }
+            if (data & 0x80) {
+                shift_ = 0x10;
+                control_ |= 0x0C;
+                update_banks();
+                return;
+            }
+            // The marker bit reaching bit 0 means this is the fifth write
+            bool complete = shift_ & 1;
+            shift_ = (shift_ >> 1) | ((data & 1) << 4);
+            if (!complete)
+                return;
+            switch ((address >> 13) & 3) {
+                case 0: control_ = shift_; break;
+                case 1: chr_bank0_ = shift_; break;
+                case 2: chr_bank1_ = shift_; break;
+                case 3: prg_bank_ = shift_ & 0xF; break;
+            }
+            shift_ = 0x10;
+            update_banks();
+        }
+    private:
+        void update_banks() {
+            static constexpr Mirroring mirroring[] = {
+                Mirroring::SingleScreenLow, Mirroring::SingleScreenHigh, Mirroring::Vertical, Mirroring::Horizontal,
+            };
+            mirroring_ = mirroring[control_ & 3];
+            switch ((control_ >> 2) & 3) {
+                case 0:
+                case 1: {
+                    map_prg(0x8000, 0x8000, prg_bank_ >> 1);
+                    break;
+                }
+                case 2: {
+                    map_prg(0x8000, 0x4000, 0);
+                    map_prg(0xC000, 0x4000, prg_bank_);
+                    break;
+                }
+                case 3: {
+                    map_prg(0x8000, 0x4000, prg_bank_);
+                    map_prg(0xC000, 0x4000, prg_bank_count(0x4000) - 1);
+                    break;
+                }
+            }
+            if (control_ & 0x10) {
+                map_chr(0x0000, 0x1000, chr_bank0_);
+                map_chr(0x1000, 0x1000, chr_bank1_);
+            } else {
+                map_chr(0x0000, 0x2000, chr_bank0_ >> 1);
+            }
+        }
+        uint8_t shift_ = 0x10;
+        uint8_t control_ = 0x0C;
+        uint8_t chr_bank0_ = 0;
+        uint8_t chr_bank1_ = 0;
+        uint8_t prg_bank_ = 0;
+    };
+
+    // Mapper 2, switchable 16KB at $8000 and the last bank fixed at $C000
+    class UxROM : public MapperBase {
+    public:
+        static constexpr int Number = 2;
+        UxROM(Cartridge& cartridge) : MapperBase(cartridge) {
+            check_sizes(0x400000, 0x2000);
+            map_prg(0x8000, 0x4000, 0);
+            map_prg(0xC000, 0x4000, prg_bank_count(0x4000) - 1);
+            map_chr(0x0000, 0x2000, 0);
+        }
+        void CpuWrite(uint16_t address, uint8_t data) {
+            if (address & 0x8000)
+                map_prg(0x8000, 0x4000, data);
+            else
+                MapperBase::CpuWrite(address, data);
+        }
+    };
+
+    // Mapper 3, switchable 8KB CHR
+    class CNROM : public MapperBase {
+    public:
+        static constexpr int Number = 3;
+        CNROM(Cartridge& cartridge) : MapperBase(cartridge) {
+            check_sizes(0x8000, 0x200000);
+            map_prg(0x8000, 0x4000, 0);
+            map_prg(0xC000, 0x4000, 1);
+            map_chr(0x0000, 0x2000, 0);
+        }
+        void CpuWrite(uint16_t address, uint8_t data) {
+            if (address & 0x8000)
+                map_chr(0x0000, 0x2000, data);
+            else
+                MapperBase::CpuWrite(address, data);
+        }
+    };
+
+    // Mapper 7, switchable 32KB PRG and single screen mirroring
+    class AxROM : public MapperBase {
+    public:
+        static constexpr int Number = 7;
+        AxROM(Cartridge& cartridge) : MapperBase(cartridge) {
+            check_sizes(0x40000, 0x2000);
+            map_prg(0x8000, 0x8000, 0);
+            map_chr(0x0000, 0x2000, 0);
+            mirroring_ = Mirroring::SingleScreenLow;
+        }
+        void CpuWrite(uint16_t address, uint8_t data) {
+            if (!(address & 0x8000)) {
+                MapperBase::CpuWrite(address, data);
+                return;
+            }
+            map_prg(0x8000, 0x8000, data & 0x7);
+            mirroring_ = (data & 0x10) ? Mirroring::SingleScreenHigh : Mirroring::SingleScreenLow;
+        }
+    };
+
+    // Constructs the mapper for mapper number and calls visitor with it. Everything the
+    // visitor instantiates is specialized for that mapper
+    template<class Visitor>
+    decltype(auto) VisitMapper(int number, Cartridge& cartridge, Visitor&& visitor) {
+        switch (number) {
+            case NROM::Number: { NROM mapper(cartridge); return visitor(mapper); }
+            case MMC1::Number: { MMC1 mapper(cartridge); return visitor(mapper); }
+            case UxROM::Number: { UxROM mapper(cartridge); return visitor(mapper); }
+            case CNROM::Number: { CNROM mapper(cartridge); return visitor(mapper); }
+            case AxROM::Number: { AxROM mapper(cartridge); return visitor(mapper); }
+        }
+        throw ErrorFactory::generate_exception(__func__, __LINE__, "Unsupported mapper " + std::to_string(number));
+    }
+}
+#endif
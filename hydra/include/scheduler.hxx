@@ -0,0 +1,73 @@
+#pragma once
+#ifndef TKP_SCHEDULER_H
+#define TKP_SCHEDULER_H
+#include <array>
+#include <cstdint>
+#include <functional>
+
+namespace TKPEmu {
+    // Timestamped event queue shared by the cores. Components (PPU, APU, timers...)
+    // schedule the cycle of their next event instead of being ticked every cycle,
+    // and the CPU runs freely until the nearest deadline:
+    //
+    //     while (running) {
+    //         while (scheduler.GetCycle() < scheduler.GetNextEventCycle())
+    //             scheduler.AddCycles(cpu.Step());
+    //         scheduler.RunEvents();
+    //     }
+    //
+    // Events are registered once and each one is either pending at a single cycle or not
+    // at all, so the heap never holds more than max_events entries and never allocates
+    class Scheduler {
+    public:
+        static constexpr int max_events = 32;
+        using EventId = int;
+        // late is how many cycles after the scheduled cycle the event actually ran,
+        // which periodic events subtract from their next period
+        using Callback = std::function<void(uint64_t late)>;
+        Scheduler() { positions_.fill(-1); }
+        EventId Register(Callback callback);
+        // Schedule, Deschedule and IsScheduled throw for ids that weren't returned by Register
+        void Schedule(EventId id, uint64_t cycle);
+        void ScheduleIn(EventId id, uint64_t cycles) {
+            Schedule(id, cycle_ + cycles);
+        }
+        void Deschedule(EventId id);
+        bool IsScheduled(EventId id) const;
+        uint64_t GetCycle() const { return cycle_; }
+        uint64_t GetNextEventCycle() const {
+            return size_ ? heap_[0].Cycle : UINT64_MAX;
+        }
+        void AddCycles(uint64_t cycles) { cycle_ += cycles; }
+        // Jumps straight to the next event, for when the CPU is halted or idle.
+        // Returns the number of cycles skipped
+        uint64_t SkipToNextEvent();
+        // Runs every event whose cycle has been reached, in cycle order.
+        // Events scheduled at the same cycle run in the order they were scheduled
+        void RunEvents();
+        void Reset();
+    private:
+        struct Entry {
+            uint64_t Cycle;
+            uint64_t Sequence;
+            EventId Id;
+        };
+        static bool before(const Entry& a, const Entry& b) {
+            return a.Cycle < b.Cycle || (a.Cycle == b.Cycle && a.Sequence < b.Sequence);
+        }
+        void throw_if_invalid(EventId id, const char* func) const;
+        void place(int index, const Entry& entry);
+        void sift_up(int index);
+        void sift_down(int index);
+        void remove_at(int index);
+        std::array<Entry, max_events> heap_ {};
+        // Index of each event in heap_, -1 if it isn't scheduled
+        std::array<int, max_events> positions_;
+        std::array<Callback, max_events> callbacks_ {};
+        int size_ = 0;
+        int registered_ = 0;
+        uint64_t cycle_ = 0;
+        uint64_t sequence_ = 0;
+    };
+}
+#endif
@@ -0,0 +1,95 @@
+#include "alloc_tracker.hxx"
+#ifdef TKP_TRACK_ALLOCATIONS
+#include <cstdlib>
+#include <new>
+
+namespace {
+    // Trivial type, so using it from operator new never needs dynamic initialization
+    thread_local TKPEmu::Tools::AllocationStats thread_stats;
+
+    void* allocate(size_t size) {
+        thread_stats.Allocations++;
+        thread_stats.Bytes += size;
+        return std::malloc(size ? size : 1);
+    }
+
+    void* allocate_aligned(size_t size, std::align_val_t alignment) {
+        thread_stats.Allocations++;
+        thread_stats.Bytes += size;
+        size_t align = static_cast<size_t>(alignment);
+        // aligned_alloc wants the size to be a multiple of the alignment
+        return std::aligned_alloc(align, (size + align - 1) / align * align);
+    }
+
+    void release(void* ptr) {
+        if (!ptr)
+            return;
+        thread_stats.Frees++;
+        std::free(ptr);
+    }
+}
+
+void* operator new(size_t size) {
+    if (void* ptr = allocate(size))
+        return ptr;
+    throw std::bad_alloc();
+}
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    return allocate(size);
+}
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return allocate(size);
+}
+void* operator new(size_t size, std::align_val_t alignment) {
+    if (void* ptr = allocate_aligned(size, alignment))
+        return ptr;
+    throw std::bad_alloc();
+}
+void* operator new[](size_t size, std::align_val_t alignment) {
+    return operator new(size, alignment);
+}
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return allocate_aligned(size, alignment);
+}
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return allocate_aligned(size, alignment);
+}
+void operator delete(void* ptr) noexcept { release(ptr); }
+void operator delete[](void* ptr) noexcept { release(ptr); }
+void operator delete(void* ptr, size_t) noexcept { release(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { release(ptr); }
+void operator delete(void* ptr, const std::nothrow_t&) noexcept { release(ptr); }
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept { release(ptr); }
+void operator delete(void* ptr, std::align_val_t) noexcept { release(ptr); }
+void operator delete[](void* ptr, std::align_val_t) noexcept { release(ptr); }
+void operator delete(void* ptr, size_t, std::align_val_t) noexcept { release(ptr); }
+void operator delete[](void* ptr, size_t, std::align_val_t) noexcept { release(ptr); }
+#endif
+
+namespace TKPEmu::Tools {
+    AllocationStats GetThreadAllocations() {
+        #ifdef TKP_TRACK_ALLOCATIONS
+        return thread_stats;
+        #else
+        return {};
+        #endif
+    }
+
+    uint64_t FrameAllocationMonitor::MarkFrame() {
+        uint64_t allocations = GetThreadAllocations().Allocations;
+        uint64_t frame_allocations = allocations - last_allocations_;
+        last_allocations_ = allocations;
+        // Counters are per thread, a frame that started on another one can't be measured
+        auto thread = std::this_thread::get_id();
+        if (thread != thread_) {
+            thread_ = thread;
+            frames_ = 0;
+            return 0;
+        }
+        frames_++;
+        return frames_ > warmup_frames_ ? frame_allocations : 0;
+    }
+}
@@ -0,0 +1,44 @@
+#pragma once
+#ifndef TKP_ALLOC_TRACKER_H
+#define TKP_ALLOC_TRACKER_H
+#include <cstdint>
+#include <thread>
+
+namespace TKPEmu::Tools {
+    // Heap allocation counting for finding hidden allocations on the emulator thread, such as
+    // a std::function that outgrew its small buffer or a request carrying a std::string.
+    // Only counts when built with -DTKP_TRACK_ALLOCATIONS=ON, which replaces the global
+    // operator new and delete. Otherwise every count stays 0
+    #ifdef TKP_TRACK_ALLOCATIONS
+    constexpr bool AllocationTracking = true;
+    #else
+    constexpr bool AllocationTracking = false;
+    #endif
+
+    struct AllocationStats {
+        uint64_t Allocations = 0;
+        uint64_t Frees = 0;
+        uint64_t Bytes = 0;
+    };
+
+    // Totals of the calling thread since it started
+    AllocationStats GetThreadAllocations();
+
+    // Counts the allocations made between frame boundaries on the thread that marks them.
+    // The first warmup_frames are never reported, that's where buffers and caches fill up
+    class FrameAllocationMonitor {
+    public:
+        FrameAllocationMonitor(uint64_t warmup_frames = 60) : warmup_frames_(warmup_frames) {}
+        // Call at the end of every frame. Returns the allocations made during the frame that
+        // just ended, or 0 while warming up
+        uint64_t MarkFrame();
+        // Starts the warm-up over, for example after a reset
+        void Reset() { frames_ = 0; }
+    private:
+        uint64_t warmup_frames_;
+        uint64_t frames_ = 0;
+        uint64_t last_allocations_ = 0;
+        std::thread::id thread_;
+    };
+}
+#endif
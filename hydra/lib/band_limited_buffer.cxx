@@ -0,0 +1,81 @@
+#include "band_limited_buffer.hxx"
+#include <algorithm>
+#include <cmath>
+#include <include/error_factory.hxx>
+
+namespace TKPEmu::Tools {
+    BandLimitedBuffer::BandLimitedBuffer(double clock_rate, double sample_rate, uint32_t max_frame_clocks) {
+        if (sample_rate >= clock_rate)
+            throw ErrorFactory::generate_exception(__func__, __LINE__, "Sample rate must be lower than the clock rate");
+        factor_ = std::ceil(sample_rate / clock_rate * (uint64_t(1) << time_bits));
+        // A frame's worth of samples, plus what's left over from the last frame and the kernel tail
+        buffer_.resize(((uint64_t(max_frame_clocks) * factor_) >> time_bits) * 2 + kernel_width * 2);
+        // Windowed sinc with the cutoff a little under Nyquist, so the transition band
+        // stays above what the short kernel can't attenuate
+        constexpr double cutoff = 0.45;
+        constexpr double pi = 3.14159265358979323846;
+        kernel_.resize(phase_count * kernel_width);
+        for (int phase = 0; phase < phase_count; phase++) {
+            double fraction = double(phase) / phase_count;
+            double row[kernel_width];
+            double sum = 0;
+            for (int i = 0; i < kernel_width; i++) {
+                double t = i - (kernel_width / 2 - 1) - fraction;
+                double x = 2 * pi * cutoff * t;
+                double sinc = t == 0 ? 1 : std::sin(x) / x;
+                // Blackman window over the kernel span
+                double w = (t + kernel_width / 2) / kernel_width;
+                double window = 0.42 - 0.5 * std::cos(2 * pi * w) + 0.08 * std::cos(4 * pi * w);
+                row[i] = sinc * window;
+                sum += row[i];
+            }
+            // Rounded so every row sums exactly to one, otherwise steps would leave DC error behind
+            int total = 0;
+            for (int i = 0; i < kernel_width; i++) {
+                int16_t tap = std::lround(row[i] / sum * (1 << kernel_bits));
+                kernel_[phase * kernel_width + i] = tap;
+                total += tap;
+            }
+            kernel_[phase * kernel_width + kernel_width / 2 - 1] += (1 << kernel_bits) - total;
+        }
+    }
+
+    void BandLimitedBuffer::AddDelta(uint32_t clock, int32_t delta) {
+        uint64_t position = offset_ + clock * factor_;
+        size_t index = position >> time_bits;
+        int phase = (position >> (time_bits - phase_bits)) & (phase_count - 1);
+        if (index + kernel_width > buffer_.size())
+            throw ErrorFactory::generate_exception(__func__, __LINE__, "Frame too long for the band-limited buffer");
+        const int16_t* taps = &kernel_[phase * kernel_width];
+        int32_t* out = &buffer_[index];
+        for (int i = 0; i < kernel_width; i++)
+            out[i] += delta * taps[i];
+    }
+
+    void BandLimitedBuffer::EndFrame(uint32_t clocks) {
+        uint64_t position = offset_ + clocks * factor_;
+        if ((position >> time_bits) + kernel_width > buffer_.size())
+            throw ErrorFactory::generate_exception(__func__, __LINE__, "Band-limited buffer full, samples must be read every frame");
+        offset_ = position;
+    }
+
+    size_t BandLimitedBuffer::ReadSamples(int16_t* out, size_t count) {
+        count = std::min(count, GetSamplesAvailable());
+        for (size_t i = 0; i < count; i++) {
+            integrator_ += buffer_[i];
+            out[i] = std::clamp<int64_t>(integrator_ >> kernel_bits, INT16_MIN, INT16_MAX);
+        }
+        // Keep the steps that haven't been read yet, including the tails of the kernels
+        size_t remaining = GetSamplesAvailable() - count + kernel_width;
+        std::copy(buffer_.begin() + count, buffer_.begin() + count + remaining, buffer_.begin());
+        std::fill(buffer_.begin() + remaining, buffer_.begin() + count + remaining, 0);
+        offset_ -= uint64_t(count) << time_bits;
+        return count;
+    }
+
+    void BandLimitedBuffer::Clear() {
+        offset_ = 0;
+        integrator_ = 0;
+        std::fill(buffer_.begin(), buffer_.end(), 0);
+    }
+}
@@ -0,0 +1,62 @@
+#pragma once
+#ifndef TKP_BAND_LIMITED_BUFFER_H
+#define TKP_BAND_LIMITED_BUFFER_H
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace TKPEmu::Tools {
+    // Band-limited step synthesis for APUs whose channels output square waves, noise and
+    // other piecewise constant signals (Game Boy, NES).
+    //
+    // Instead of producing a sample every emulated cycle, channels only report the clock
+    // at which their amplitude changes and by how much. Each change is added to the
+    // buffer as a band-limited step, so the output is free of the aliasing naive
+    // downsampling gets, and the APU does no work on cycles where nothing changes.
+    // At the end of every frame the buffer turns the steps into samples at the output rate:
+    //
+    //     channel.Update(buffer, clock, volume);      // whenever the output changes
+    //     buffer.EndFrame(clocks_this_frame);
+    //     buffer.ReadSamples(out, buffer.GetSamplesAvailable());
+    class BandLimitedBuffer {
+    public:
+        // max_frame_clocks is the longest frame EndFrame will be called with
+        BandLimitedBuffer(double clock_rate, double sample_rate = 48000, uint32_t max_frame_clocks = 1 << 20);
+        // Adds a step of delta at clock, counted from the start of the current frame
+        void AddDelta(uint32_t clock, int32_t delta);
+        // Ends the frame at clock clocks, making its samples available. The next
+        // frame's clocks start from there. Throws if the samples of earlier frames
+        // weren't read and there's no room left for this one
+        void EndFrame(uint32_t clocks);
+        size_t GetSamplesAvailable() const { return offset_ >> time_bits; }
+        // Removes up to count samples and writes them to out, returns how many were written
+        size_t ReadSamples(int16_t* out, size_t count);
+        void Clear();
+    private:
+        static constexpr int time_bits = 32;
+        static constexpr int phase_bits = 6;
+        static constexpr int phase_count = 1 << phase_bits;
+        static constexpr int kernel_width = 16;
+        static constexpr int kernel_bits = 15;
+        uint64_t factor_;
+        // Position of the current frame's start in samples, time_bits of fraction
+        uint64_t offset_ = 0;
+        int64_t integrator_ = 0;
+        std::vector<int32_t> buffer_;
+        // Impulse response for each fractional sample position, rows sum to 1 << kernel_bits
+        std::vector<int16_t> kernel_;
+    };
+
+    // Remembers the last amplitude of a channel so that it only adds deltas when it changes
+    struct BandLimitedChannel {
+        int32_t Amplitude = 0;
+        void Update(BandLimitedBuffer& buffer, uint32_t clock, int32_t amplitude) {
+            int32_t delta = amplitude - Amplitude;
+            if (delta) {
+                Amplitude = amplitude;
+                buffer.AddDelta(clock, delta);
+            }
+        }
+    };
+}
+#endif
@@ -0,0 +1,32 @@
+#pragma once
+#ifndef TKP_BANK_MAP_H
+#define TKP_BANK_MAP_H
+#include <array>
+#include <cstdint>
+
+namespace TKPEmu::Tools {
+    // Address space split into equally sized windows, each pointing directly at the
+    // bank currently switched in. Mappers update the pointers when a banking register
+    // changes so that reads are a shift, a mask and an indexed dereference
+    template<unsigned WindowBits, unsigned Windows>
+    class BankMap {
+    public:
+        static constexpr uint32_t window_size = 1 << WindowBits;
+        static constexpr uint32_t window_mask = window_size - 1;
+        // Maps count consecutive windows starting at first to consecutive memory at data
+        void Map(unsigned first, unsigned count, uint8_t* data) {
+            for (unsigned i = 0; i < count; i++)
+                pointers_[first + i] = data + i * window_size;
+        }
+        uint8_t Read(uint32_t offset) const {
+            return pointers_[offset >> WindowBits][offset & window_mask];
+        }
+        void Write(uint32_t offset, uint8_t value) {
+            pointers_[offset >> WindowBits][offset & window_mask] = value;
+        }
+        const uint8_t* GetWindow(unsigned window) const { return pointers_[window]; }
+    private:
+        std::array<uint8_t*, Windows> pointers_ {};
+    };
+}
+#endif
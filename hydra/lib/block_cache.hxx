@@ -0,0 +1,111 @@
+#pragma once
+#ifndef TKP_BLOCK_CACHE_H
+#define TKP_BLOCK_CACHE_H
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace TKPEmu::Tools {
+    // Cache of translated or pre-decoded guest code blocks, shared by the recompiler
+    // and cached interpreter cores.
+    //
+    // Blocks are keyed by the location of their first instruction, usually the physical
+    // address, or bank << 16 | address on banked systems. Every page a block covers is
+    // marked in a bitmap so that a write can check in one load whether it touched code
+    // and only then drop the blocks on that page
+    template<class Block, unsigned LocationBits = 32, unsigned PageBits = 12>
+    class BlockCache {
+    public:
+        BlockCache() : code_pages_(page_count, 0) {}
+        BlockCache(const BlockCache&) = delete;
+        BlockCache& operator=(const BlockCache&) = delete;
+        // Returns nullptr if there's no block at that location
+        Block* Find(uint64_t location) {
+            auto it = blocks_.find(location);
+            return it == blocks_.end() ? nullptr : &it->second.Value;
+        }
+        // size is the number of bytes of guest code the block covers. A block running past
+        // the end of the location space wraps around and is registered on the pages at both ends.
+        // Inserting at a location that already has a block replaces it
+        Block& Insert(uint64_t location, uint32_t size, Block block) {
+            if (auto it = blocks_.find(location); it != blocks_.end())
+                remove(it);
+            uint64_t first_page = get_page(location);
+            uint64_t offset = location & ((uint64_t(1) << PageBits) - 1);
+            uint64_t pages = std::min(((offset + std::max(size, 1u) - 1) >> PageBits) + 1, page_count);
+            for (uint64_t i = 0; i < pages; i++) {
+                uint64_t page = (first_page + i) & (page_count - 1);
+                code_pages_[page] = 1;
+                page_blocks_[page].push_back(location);
+                registrations_++;
+            }
+            auto& entry = blocks_.insert_or_assign(location, Entry { std::move(block), first_page, pages }).first->second;
+            return entry.Value;
+        }
+        // Must be called on every write to memory that can hold code
+        void InvalidateWrite(uint64_t location) {
+            uint64_t page = get_page(location);
+            if (code_pages_[page]) [[unlikely]] {
+                invalidate_page(page);
+            }
+        }
+        void Clear() {
+            generation_++;
+            blocks_.clear();
+            page_blocks_.clear();
+            registrations_ = 0;
+            std::fill(code_pages_.begin(), code_pages_.end(), 0);
+        }
+        size_t GetBlockCount() const { return blocks_.size(); }
+        // Changes every time blocks are dropped, so code running out of a block
+        // can tell that the rest of it may no longer be valid
+        uint64_t GetGeneration() const { return generation_; }
+        // Page to block links, one per page of every cached block
+        size_t GetRegistrationCount() const { return registrations_; }
+    private:
+        struct Entry {
+            Block Value;
+            uint64_t FirstPage;
+            uint64_t Pages;
+        };
+        static constexpr uint64_t page_count = uint64_t(1) << (LocationBits - PageBits);
+        static uint64_t get_page(uint64_t location) {
+            return (location >> PageBits) & (page_count - 1);
+        }
+        void invalidate_page(uint64_t page) {
+            generation_++;
+            auto it = page_blocks_.find(page);
+            if (it != page_blocks_.end()) {
+                // Copied, removing the blocks edits this list too
+                std::vector<uint64_t> locations = it->second;
+                for (uint64_t location : locations) {
+                    if (auto block = blocks_.find(location); block != blocks_.end())
+                        remove(block);
+                }
+            }
+            code_pages_[page] = 0;
+        }
+        // Drops a block and its links from every page it covers
+        void remove(typename std::unordered_map<uint64_t, Entry>::iterator it) {
+            for (uint64_t i = 0; i < it->second.Pages; i++) {
+                uint64_t page = (it->second.FirstPage + i) & (page_count - 1);
+                auto list = page_blocks_.find(page);
+                if (list == page_blocks_.end())
+                    continue;
+                registrations_ -= std::erase(list->second, it->first);
+                if (list->second.empty()) {
+                    page_blocks_.erase(list);
+                    code_pages_[page] = 0;
+                }
+            }
+            blocks_.erase(it);
+        }
+        std::unordered_map<uint64_t, Entry> blocks_;
+        std::unordered_map<uint64_t, std::vector<uint64_t>> page_blocks_;
+        std::vector<uint8_t> code_pages_;
+        uint64_t generation_ = 0;
+        size_t registrations_ = 0;
+    };
+}
+#endif
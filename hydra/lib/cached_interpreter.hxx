@@ -0,0 +1,80 @@
+#pragma once
+#ifndef TKP_CACHED_INTERPRETER_H
+#define TKP_CACHED_INTERPRETER_H
+#include <memory>
+#include <vector>
+#include "block_cache.hxx"
+
+namespace TKPEmu::Tools {
+    // An instruction decoded once into its handler and operands
+    template<class Cpu>
+    struct DecodedInstruction {
+        // Returns false to leave the block early, for example on a taken branch
+        using Handler = bool(*)(Cpu&, const DecodedInstruction&);
+        Handler Execute;
+        uint32_t Operand;
+        uint8_t Length;
+        uint8_t Cycles;
+    };
+
+    template<class Cpu>
+    struct DecodedBlock {
+        std::vector<DecodedInstruction<Cpu>> Instructions;
+        uint32_t Size = 0;
+    };
+
+    // Runs straight-line guest code out of pre-decoded blocks instead of decoding every
+    // opcode on each fetch. Blocks end after a control flow instruction, so the core still
+    // gets control back at every branch to handle interrupts and timing
+    //
+    // Cpu must provide:
+    // bool Decode(uint64_t location, DecodedInstruction<Cpu>& out)
+    //     decodes the instruction at location and returns true if it ends the block
+    // Writes to memory that can hold code must go through InvalidateWrite
+    template<class Cpu, unsigned LocationBits = 25, unsigned PageBits = 8>
+    class CachedInterpreter {
+    public:
+        static constexpr size_t max_block_instructions = 64;
+        // Executes the block at location, decoding it first if needed.
+        // Returns the number of instructions executed
+        size_t Run(Cpu& cpu, uint64_t location) {
+            std::shared_ptr<const DecodedBlock<Cpu>>* cached = cache_.Find(location);
+            std::shared_ptr<const DecodedBlock<Cpu>> block = cached ? *cached : decode(cpu, location);
+            uint64_t generation = cache_.GetGeneration();
+            size_t executed = 0;
+            for (const auto& instruction : block->Instructions) {
+                executed++;
+                if (!instruction.Execute(cpu, instruction))
+                    break;
+                // The block overwrote code, possibly itself, so the rest has to be decoded again
+                if (cache_.GetGeneration() != generation) [[unlikely]]
+                    break;
+            }
+            return executed;
+        }
+        void InvalidateWrite(uint64_t location) {
+            cache_.InvalidateWrite(location);
+        }
+        void Clear() {
+            cache_.Clear();
+        }
+    private:
+        std::shared_ptr<const DecodedBlock<Cpu>> decode(Cpu& cpu, uint64_t location) {
+            auto block = std::make_shared<DecodedBlock<Cpu>>();
+            uint64_t current = location;
+            bool ends_block = false;
+            while (!ends_block && block->Instructions.size() < max_block_instructions) {
+                DecodedInstruction<Cpu> instruction {};
+                ends_block = cpu.Decode(current, instruction);
+                block->Instructions.push_back(instruction);
+                current += instruction.Length;
+            }
+            uint32_t size = current - location;
+            block->Size = size;
+            return cache_.Insert(location, size, std::move(block));
+        }
+        // Blocks are shared so that the one being executed stays alive if it invalidates itself
+        BlockCache<std::shared_ptr<const DecodedBlock<Cpu>>, LocationBits, PageBits> cache_;
+    };
+}
+#endif
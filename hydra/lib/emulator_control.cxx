@@ -0,0 +1,58 @@
+#include "emulator_control.hxx"
+
+namespace TKPEmu::Tools {
+    uint32_t EmulatorControl::make_word(uint32_t old_word, RunState state, StepMode mode) {
+        uint32_t sequence = (old_word >> sequence_shift) + 1;
+        return (sequence << sequence_shift) | (static_cast<uint32_t>(mode) << mode_shift) | static_cast<uint32_t>(state);
+    }
+    void EmulatorControl::set(RunState state, StepMode mode) {
+        uint32_t word = word_.load();
+        do {
+            if (get_state(word) == RunState::Stopped)
+                return;
+        } while (!word_.compare_exchange_weak(word, make_word(word, state, mode)));
+        word_.notify_all();
+    }
+    void EmulatorControl::Pause() {
+        set(RunState::Paused, StepMode::None);
+    }
+    void EmulatorControl::Resume() {
+        set(RunState::Running, StepMode::None);
+    }
+    void EmulatorControl::Stop() {
+        uint32_t word = word_.load();
+        while (!word_.compare_exchange_weak(word, make_word(word, RunState::Stopped, StepMode::None)));
+        word_.notify_all();
+    }
+    void EmulatorControl::StepInstruction() {
+        set(RunState::Running, StepMode::Instruction);
+    }
+    void EmulatorControl::StepScanline() {
+        set(RunState::Running, StepMode::Scanline);
+    }
+    void EmulatorControl::StepFrame() {
+        set(RunState::Running, StepMode::Frame);
+    }
+    void EmulatorControl::RunToCycle(uint64_t cycle) {
+        // Published before the word so the emulator thread never sees Cycle mode with a stale target
+        target_cycle_.store(cycle);
+        set(RunState::Running, StepMode::Cycle);
+    }
+    bool EmulatorControl::Wait() {
+        uint32_t word = word_.load(std::memory_order_acquire);
+        while (get_state(word) == RunState::Paused) {
+            word_.wait(word, std::memory_order_acquire);
+            word = word_.load(std::memory_order_acquire);
+        }
+        return get_state(word) != RunState::Stopped;
+    }
+    void EmulatorControl::on_boundary(uint32_t word, StepMode mode, uint64_t cycle) {
+        StepMode current = get_mode(word);
+        bool reached = (current == mode) || (current == StepMode::Cycle && mode == StepMode::Instruction && cycle >= target_cycle_.load());
+        if (!reached)
+            return;
+        // If the UI changed the state in the meantime its request wins
+        if (word_.compare_exchange_strong(word, make_word(word, RunState::Paused, StepMode::None)))
+            word_.notify_all();
+    }
+}
@@ -0,0 +1,90 @@
+#pragma once
+#ifndef TKP_EMULATOR_CONTROL_H
+#define TKP_EMULATOR_CONTROL_H
+#include <atomic>
+#include <cstdint>
+
+namespace TKPEmu::Tools {
+    // Run state of an emulator packed in a single atomic word so that the emulator thread
+    // can sleep on it with std::atomic::wait while paused and the UI can wake it with notify
+    //
+    // Bits 0-1: RunState
+    // Bits 2-4: StepMode, which boundary to pause at next when stepping
+    // Bits 8-31: sequence number, bumped on every change so that waiters always wake up
+    class EmulatorControl {
+    public:
+        enum class RunState : uint32_t {
+            Running = 0,
+            Paused = 1,
+            Stopped = 2,
+        };
+        enum class StepMode : uint32_t {
+            None = 0,
+            Instruction = 1,
+            Scanline = 2,
+            Frame = 3,
+            Cycle = 4,
+        };
+        void Pause();
+        void Resume();
+        void Stop();
+        // Runs until the next boundary of that kind is reached and then pauses again
+        void StepInstruction();
+        void StepScanline();
+        void StepFrame();
+        // Runs until the cycle counter reported by the emulator reaches cycle and then pauses
+        void RunToCycle(uint64_t cycle);
+        RunState GetState() const { return get_state(word_.load()); }
+        StepMode GetStepMode() const { return get_mode(word_.load()); }
+        bool IsPaused() const { return GetState() == RunState::Paused; }
+        bool IsStopped() const { return GetState() == RunState::Stopped; }
+        // The pending RunToCycle target, or UINT64_MAX if not running to a cycle
+        uint64_t GetTargetCycle() const {
+            return GetStepMode() == StepMode::Cycle ? target_cycle_.load() : UINT64_MAX;
+        }
+
+        // Emulator thread side
+        // Blocks without spinning while paused. Returns false if the emulator should stop.
+        // Scanline, frame and cycle stepping need the core to call this and the On* hooks
+        bool Wait();
+        // Called by the emulator when it crosses a boundary. These are on the hot path so
+        // the common case is a single relaxed load and compare
+        void OnInstruction(uint64_t cycle) {
+            uint32_t word = word_.load(std::memory_order_relaxed);
+            if (word & mode_mask) [[unlikely]] {
+                on_boundary(word, StepMode::Instruction, cycle);
+            }
+        }
+        void OnScanline() {
+            uint32_t word = word_.load(std::memory_order_relaxed);
+            if (word & mode_mask) [[unlikely]] {
+                on_boundary(word, StepMode::Scanline, 0);
+            }
+        }
+        void OnFrame() {
+            uint32_t word = word_.load(std::memory_order_relaxed);
+            if (word & mode_mask) [[unlikely]] {
+                on_boundary(word, StepMode::Frame, 0);
+            }
+        }
+    private:
+        static constexpr uint32_t state_mask = 0b11;
+        static constexpr uint32_t mode_shift = 2;
+        static constexpr uint32_t mode_mask = 0b111 << mode_shift;
+        static constexpr uint32_t sequence_shift = 8;
+        static RunState get_state(uint32_t word) {
+            return static_cast<RunState>(word & state_mask);
+        }
+        static StepMode get_mode(uint32_t word) {
+            return static_cast<StepMode>((word & mode_mask) >> mode_shift);
+        }
+        static uint32_t make_word(uint32_t old_word, RunState state, StepMode mode);
+        // Sets a new state and wakes up the emulator thread. Stopped is final
+        // so a late Pause can't revive a closing emulator
+        void set(RunState state, StepMode mode);
+        void on_boundary(uint32_t word, StepMode mode, uint64_t cycle);
+        std::atomic<uint32_t> word_ = 0;
+        std::atomic<uint64_t> target_cycle_ = 0;
+    };
+}
+#endif
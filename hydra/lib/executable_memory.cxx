@@ -0,0 +1,68 @@
+#include "executable_memory.hxx"
+#include <include/error_factory.hxx>
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+namespace TKPEmu::Tools {
+    ExecutableMemory::ExecutableMemory(size_t size) : size_(size) {
+        #if defined(_WIN32)
+        memory_ = static_cast<uint8_t*>(VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+        if (!memory_)
+            throw ErrorFactory::generate_exception(__func__, __LINE__, "Failed to allocate executable memory");
+        #else
+        void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (ptr == MAP_FAILED)
+            throw ErrorFactory::generate_exception(__func__, __LINE__, "Failed to allocate executable memory");
+        memory_ = static_cast<uint8_t*>(ptr);
+        #endif
+    }
+
+    ExecutableMemory::~ExecutableMemory() {
+        #if defined(_WIN32)
+        VirtualFree(memory_, 0, MEM_RELEASE);
+        #else
+        munmap(memory_, size_);
+        #endif
+    }
+
+    uint8_t* ExecutableMemory::Allocate(size_t size, size_t alignment) {
+        size_t start = (used_ + alignment - 1) & ~(alignment - 1);
+        if (start + size > size_)
+            return nullptr;
+        used_ = start + size;
+        return memory_ + start;
+    }
+
+    void ExecutableMemory::Reset() {
+        used_ = 0;
+    }
+
+    void ExecutableMemory::Protect() {
+        #if defined(_WIN32)
+        DWORD old;
+        bool failed = !VirtualProtect(memory_, size_, PAGE_EXECUTE_READ, &old);
+        if (!failed)
+            FlushInstructionCache(GetCurrentProcess(), memory_, size_);
+        #else
+        bool failed = mprotect(memory_, size_, PROT_READ | PROT_EXEC) != 0;
+        if (!failed)
+            __builtin___clear_cache(reinterpret_cast<char*>(memory_), reinterpret_cast<char*>(memory_ + size_));
+        #endif
+        if (failed)
+            throw ErrorFactory::generate_exception(__func__, __LINE__, "Failed to protect executable memory");
+    }
+
+    void ExecutableMemory::Unprotect() {
+        #if defined(_WIN32)
+        DWORD old;
+        bool failed = !VirtualProtect(memory_, size_, PAGE_READWRITE, &old);
+        #else
+        bool failed = mprotect(memory_, size_, PROT_READ | PROT_WRITE) != 0;
+        #endif
+        if (failed)
+            throw ErrorFactory::generate_exception(__func__, __LINE__, "Failed to unprotect executable memory");
+    }
+}
@@ -0,0 +1,33 @@
+#pragma once
+#ifndef TKP_EXECUTABLE_MEMORY_H
+#define TKP_EXECUTABLE_MEMORY_H
+#include <cstddef>
+#include <cstdint>
+
+namespace TKPEmu::Tools {
+    // Arena for host code emitted by a recompiler. Memory is either writable or
+    // executable, never both, so emit with the arena unprotected and call Protect
+    // before running anything out of it
+    class ExecutableMemory {
+    public:
+        ExecutableMemory(size_t size);
+        ~ExecutableMemory();
+        ExecutableMemory(const ExecutableMemory&) = delete;
+        ExecutableMemory& operator=(const ExecutableMemory&) = delete;
+        // Returns nullptr when the arena is full, at which point the caller is
+        // expected to flush its block cache and call Reset
+        uint8_t* Allocate(size_t size, size_t alignment = 16);
+        void Reset();
+        // Switches the arena to read/execute
+        void Protect();
+        // Switches the arena to read/write
+        void Unprotect();
+        size_t GetUsed() const { return used_; }
+        size_t GetSize() const { return size_; }
+    private:
+        uint8_t* memory_ = nullptr;
+        size_t size_ = 0;
+        size_t used_ = 0;
+    };
+}
+#endif
@@ -0,0 +1,146 @@
+#include "fastmem.hxx"
+#include <atomic>
+#include <mutex>
+#include <include/error_factory.hxx>
+#if defined(__linux__)
+#include <signal.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    constexpr uint64_t reserve_size = uint64_t(1) << 32;
+    // Instances the signal handler checks faults against. Fixed size so the
+    // handler doesn't have to take a lock or allocate
+    constexpr int max_instances = 4;
+    std::atomic<TKPEmu::Tools::Fastmem*> instances[max_instances];
+    #if defined(__linux__)
+    struct sigaction previous_action;
+    std::once_flag install_flag;
+    #endif
+}
+
+namespace TKPEmu::Tools {
+    bool Fastmem::IsSupported() {
+        #if defined(__linux__) && (defined(__x86_64__) || defined(__aarch64__))
+        return true;
+        #else
+        return false;
+        #endif
+    }
+
+    Fastmem::Fastmem(size_t ram_size) : ram_size_(ram_size), mapped_pages_(reserve_size / page_size / 8, 0) {
+        if (!IsSupported())
+            throw ErrorFactory::generate_exception(__func__, __LINE__, "Fastmem is not supported on this host");
+        #if defined(__linux__)
+        try {
+            ram_fd_ = memfd_create("tkp_fastmem", 0);
+            if (ram_fd_ == -1 || ftruncate(ram_fd_, ram_size) != 0)
+                throw ErrorFactory::generate_exception(__func__, __LINE__, "Failed to create fastmem backing memory");
+            void* ram = mmap(nullptr, ram_size, PROT_READ | PROT_WRITE, MAP_SHARED, ram_fd_, 0);
+            if (ram == MAP_FAILED)
+                throw ErrorFactory::generate_exception(__func__, __LINE__, "Failed to map fastmem backing memory");
+            ram_ = static_cast<uint8_t*>(ram);
+            void* base = mmap(nullptr, reserve_size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+            if (base == MAP_FAILED)
+                throw ErrorFactory::generate_exception(__func__, __LINE__, "Failed to reserve fastmem address space");
+            base_ = static_cast<uint8_t*>(base);
+            std::call_once(install_flag, []() {
+                struct sigaction action {};
+                action.sa_sigaction = reinterpret_cast<void(*)(int, siginfo_t*, void*)>(&Fastmem::signal_handler);
+                action.sa_flags = SA_SIGINFO | SA_NODEFER;
+                sigemptyset(&action.sa_mask);
+                sigaction(SIGSEGV, &action, &previous_action);
+            });
+            for (auto& instance : instances) {
+                Fastmem* expected = nullptr;
+                if (instance.compare_exchange_strong(expected, this))
+                    return;
+            }
+            throw ErrorFactory::generate_exception(__func__, __LINE__, "Too many fastmem instances");
+        } catch (...) {
+            // The destructor doesn't run for a constructor that throws
+            release();
+            throw;
+        }
+        #endif
+    }
+
+    Fastmem::~Fastmem() {
+        release();
+    }
+
+    void Fastmem::release() {
+        for (auto& instance : instances) {
+            Fastmem* expected = this;
+            instance.compare_exchange_strong(expected, nullptr);
+        }
+        #if defined(__linux__)
+        if (base_)
+            munmap(base_, reserve_size);
+        if (ram_)
+            munmap(ram_, ram_size_);
+        if (ram_fd_ != -1)
+            close(ram_fd_);
+        #endif
+        base_ = nullptr;
+        ram_ = nullptr;
+        ram_fd_ = -1;
+    }
+
+    void Fastmem::MapRam(uint32_t guest_address, size_t size, size_t ram_offset) {
+        if ((guest_address | size | ram_offset) & (page_size - 1))
+            throw ErrorFactory::generate_exception(__func__, __LINE__, "Fastmem mappings must be page aligned");
+        if (ram_offset + size > ram_size_ || guest_address + size > reserve_size)
+            throw ErrorFactory::generate_exception(__func__, __LINE__, "Fastmem mapping out of range");
+        #if defined(__linux__)
+        if (mmap(base_ + guest_address, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, ram_fd_, ram_offset) == MAP_FAILED)
+            throw ErrorFactory::generate_exception(__func__, __LINE__, "Failed to map fastmem page");
+        #endif
+        set_mapped(guest_address, size, true);
+    }
+
+    void Fastmem::Unmap(uint32_t guest_address, size_t size) {
+        if ((guest_address | size) & (page_size - 1))
+            throw ErrorFactory::generate_exception(__func__, __LINE__, "Fastmem mappings must be page aligned");
+        set_mapped(guest_address, size, false);
+        #if defined(__linux__)
+        if (mmap(base_ + guest_address, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_NORESERVE, -1, 0) == MAP_FAILED)
+            throw ErrorFactory::generate_exception(__func__, __LINE__, "Failed to unmap fastmem page");
+        #endif
+    }
+
+    void Fastmem::set_mapped(uint32_t guest_address, size_t size, bool mapped) {
+        uint64_t first = guest_address >> page_bits;
+        uint64_t last = (uint64_t(guest_address) + size) >> page_bits;
+        for (uint64_t page = first; page < last; page++) {
+            if (mapped)
+                mapped_pages_[page >> 3] |= 1 << (page & 7);
+            else
+                mapped_pages_[page >> 3] &= ~(1 << (page & 7));
+        }
+    }
+
+    void Fastmem::signal_handler(int signal, void* info, void* context) {
+        #if defined(__linux__)
+        auto* address = static_cast<uint8_t*>(static_cast<siginfo_t*>(info)->si_addr);
+        for (auto& instance : instances) {
+            Fastmem* fastmem = instance.load();
+            if (!fastmem || address < fastmem->base_ || address >= fastmem->base_ + reserve_size)
+                continue;
+            if (fastmem->fault_handler_ && fastmem->fault_handler_(address - fastmem->base_, context))
+                return;
+            break;
+        }
+        // Not ours or not handled, let whoever was there before deal with it
+        if (previous_action.sa_flags & SA_SIGINFO) {
+            previous_action.sa_sigaction(signal, static_cast<siginfo_t*>(info), context);
+        } else if (previous_action.sa_handler == SIG_DFL || previous_action.sa_handler == SIG_IGN) {
+            // Returning re-executes the access which now crashes the usual way
+            ::signal(signal, SIG_DFL);
+        } else {
+            previous_action.sa_handler(signal);
+        }
+        #endif
+    }
+}
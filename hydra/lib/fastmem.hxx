@@ -0,0 +1,84 @@
+#pragma once
+#ifndef TKP_FASTMEM_H
+#define TKP_FASTMEM_H
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <vector>
+
+namespace TKPEmu::Tools {
+    // Maps a 32 bit guest physical address space onto a 4 GB host reservation so that
+    // a guest RAM access is base + address. RAM is backed by a shared memory file and
+    // can be mapped more than once for mirrors. Everything else, MMIO included, stays
+    // unmapped so that touching it faults.
+    //
+    // Recompiled code accesses GetBase() directly and relies on the fault handler to
+    // catch MMIO, where it can backpatch the access into a call to the slow path.
+    // Interpreters use Read and Write, which check a page bitmap before the host access.
+    // Only Linux is supported for now, on other hosts IsSupported returns false and
+    // cores keep their software address decoding
+    class Fastmem {
+    public:
+        static constexpr unsigned page_bits = 12;
+        static constexpr uint64_t page_size = uint64_t(1) << page_bits;
+        // Called on a fault inside the reserved region with the guest address and the host's
+        // ucontext_t. Return true if the fault was handled, the faulting instruction is then
+        // retried, so the handler must either map the page or move the host PC past it
+        using FaultHandler = std::function<bool(uint32_t guest_address, void* context)>;
+        static bool IsSupported();
+        // ram_size is the size of the backing memory that MapRam can map views of
+        Fastmem(size_t ram_size);
+        ~Fastmem();
+        Fastmem(const Fastmem&) = delete;
+        Fastmem& operator=(const Fastmem&) = delete;
+        // Maps size bytes of backing memory starting at ram_offset to guest_address.
+        // All three must be page aligned
+        void MapRam(uint32_t guest_address, size_t size, size_t ram_offset);
+        void Unmap(uint32_t guest_address, size_t size);
+        void SetFaultHandler(FaultHandler handler) { fault_handler_ = std::move(handler); }
+        uint8_t* GetBase() const { return base_; }
+        // The backing memory itself, for DMA and savestates
+        uint8_t* GetRam() const { return ram_; }
+        bool IsMapped(uint32_t guest_address) const {
+            uint32_t page = guest_address >> page_bits;
+            return mapped_pages_[page >> 3] & (1 << (page & 7));
+        }
+        // Raw host-endian accesses that fall back to slow for unmapped pages, and for accesses
+        // that straddle into an unmapped page or past the top of the address space
+        template<class T, class SlowRead>
+        T Read(uint32_t guest_address, SlowRead&& slow) const {
+            if (is_fast<T>(guest_address)) [[likely]] {
+                T value;
+                std::memcpy(&value, base_ + guest_address, sizeof(T));
+                return value;
+            }
+            return slow(guest_address);
+        }
+        template<class T, class SlowWrite>
+        void Write(uint32_t guest_address, T value, SlowWrite&& slow) {
+            if (is_fast<T>(guest_address)) [[likely]] {
+                std::memcpy(base_ + guest_address, &value, sizeof(T));
+                return;
+            }
+            slow(guest_address, value);
+        }
+    private:
+        template<class T>
+        bool is_fast(uint32_t guest_address) const {
+            uint32_t last = guest_address + (sizeof(T) - 1);
+            return IsMapped(guest_address) && last >= guest_address && IsMapped(last);
+        }
+        static void signal_handler(int signal, void* info, void* context);
+        // Unmaps and closes whatever has been set up so far, for the destructor and for
+        // constructors that throw halfway
+        void release();
+        void set_mapped(uint32_t guest_address, size_t size, bool mapped);
+        uint8_t* base_ = nullptr;
+        uint8_t* ram_ = nullptr;
+        size_t ram_size_ = 0;
+        int ram_fd_ = -1;
+        std::vector<uint8_t> mapped_pages_;
+        FaultHandler fault_handler_;
+    };
+}
+#endif
@@ -0,0 +1,39 @@
+#pragma once
+#ifndef TKP_FRAME_HASH_H
+#define TKP_FRAME_HASH_H
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace TKPEmu::Tools {
+    // Fast non-cryptographic 64-bit hash for telling whether a framebuffer changed since the
+    // last frame. Four independent lanes keep the multiplies from waiting on each other, so
+    // hashing a 256x240 RGBA frame costs about as much as reading it once
+    inline uint64_t HashFrame(const void* data, size_t size) {
+        constexpr uint64_t prime1 = 0x9E3779B185EBCA87ull;
+        constexpr uint64_t prime2 = 0xC2B2AE3D27D4EB4Full;
+        auto mix = [](uint64_t hash, uint64_t word) {
+            hash ^= word * prime2;
+            hash = (hash << 31) | (hash >> 33);
+            return hash * prime1;
+        };
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        uint64_t lanes[4] = { prime1, prime2, ~prime1, ~prime2 };
+        size_t i = 0;
+        for (; i + 32 <= size; i += 32) {
+            uint64_t words[4];
+            std::memcpy(words, bytes + i, 32);
+            for (int lane = 0; lane < 4; lane++)
+                lanes[lane] = mix(lanes[lane], words[lane]);
+        }
+        uint64_t hash = size;
+        for (int lane = 0; lane < 4; lane++)
+            hash = mix(hash, lanes[lane]);
+        for (; i < size; i++)
+            hash = mix(hash, bytes[i]);
+        hash ^= hash >> 29;
+        hash *= prime1;
+        return hash ^ (hash >> 32);
+    }
+}
+#endif
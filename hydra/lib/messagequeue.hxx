@@ -21,6 +21,10 @@ enum class RequestId : int {
     COMMON_RESET = 0x101,
     COMMON_START_LOG = 0x102,
     COMMON_STOP_LOG = 0x103,
+    COMMON_START_RECORDING = 0x104,
+    COMMON_STOP_RECORDING = 0x105,
+    COMMON_START_AV_RECORDING = 0x106,
+    COMMON_STOP_AV_RECORDING = 0x107,
 };
 
 struct Request {
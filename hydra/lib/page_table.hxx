@@ -0,0 +1,65 @@
+#pragma once
+#ifndef TKP_PAGE_TABLE_H
+#define TKP_PAGE_TABLE_H
+#include <array>
+#include <cstdint>
+
+namespace TKPEmu::Tools {
+    // Memory map as one read and one write pointer per page. Pages backed by plain memory
+    // (ROM banks, WRAM, cartridge RAM) point at it directly, so those accesses are an indexed
+    // load with no address decoding. Everything else (I/O registers, MBC registers, memory
+    // the PPU has locked) is a null sentinel that falls back to the Io handler.
+    //
+    // The tables are only rebuilt when the mapping changes, for example when the MBC switches
+    // banks from inside Io::IoWrite.
+    //
+    // Io must provide:
+    // uint8_t IoRead(uint32_t address)
+    // void IoWrite(uint32_t address, uint8_t data)
+    template<class Io, unsigned AddressBits = 16, unsigned PageBits = 8>
+    class PageTable {
+    public:
+        static constexpr uint32_t page_count = 1 << (AddressBits - PageBits);
+        static constexpr uint32_t page_size = 1 << PageBits;
+        static constexpr uint32_t page_mask = page_size - 1;
+        PageTable(Io& io) : io_(io) {}
+        uint8_t Read(uint32_t address) {
+            const uint8_t* page = read_[address >> PageBits];
+            if (page) [[likely]]
+                return page[address & page_mask];
+            return io_.IoRead(address);
+        }
+        void Write(uint32_t address, uint8_t data) {
+            uint8_t* page = write_[address >> PageBits];
+            if (page) [[likely]]
+                page[address & page_mask] = data;
+            else
+                io_.IoWrite(address, data);
+        }
+        // Maps size bytes at address to data, for reads only. address and size must be page aligned
+        void MapRead(uint32_t address, uint32_t size, const uint8_t* data) {
+            for (uint32_t i = 0; i < size / page_size; i++)
+                read_[(address >> PageBits) + i] = data + i * page_size;
+        }
+        void MapWrite(uint32_t address, uint32_t size, uint8_t* data) {
+            for (uint32_t i = 0; i < size / page_size; i++)
+                write_[(address >> PageBits) + i] = data + i * page_size;
+        }
+        void Map(uint32_t address, uint32_t size, uint8_t* data) {
+            MapRead(address, size, data);
+            MapWrite(address, size, data);
+        }
+        // Sends accesses to these pages to the Io handler
+        void Unmap(uint32_t address, uint32_t size) {
+            for (uint32_t i = 0; i < size / page_size; i++) {
+                read_[(address >> PageBits) + i] = nullptr;
+                write_[(address >> PageBits) + i] = nullptr;
+            }
+        }
+    private:
+        Io& io_;
+        std::array<const uint8_t*, page_count> read_ {};
+        std::array<uint8_t*, page_count> write_ {};
+    };
+}
+#endif
@@ -0,0 +1,63 @@
+#include "png_writer.hxx"
+#include <cstring>
+#include <fstream>
+#include <zlib.h>
+#include <include/error_factory.hxx>
+
+namespace {
+    // zlib stream of the filtered rows. Emulator screens are mostly flat areas, which the
+    // fastest level already shrinks to a fraction of their size
+    std::vector<uint8_t> compress(const std::vector<uint8_t>& data) {
+        uLongf size = compressBound(data.size());
+        std::vector<uint8_t> out(size);
+        if (compress2(out.data(), &size, data.data(), data.size(), Z_BEST_SPEED) != Z_OK)
+            throw ErrorFactory::generate_exception(__func__, __LINE__, "Failed to compress PNG data");
+        out.resize(size);
+        return out;
+    }
+
+    void put_u32(std::vector<uint8_t>& out, uint32_t value) {
+        for (int shift = 24; shift >= 0; shift -= 8)
+            out.push_back(value >> shift);
+    }
+
+    void put_chunk(std::vector<uint8_t>& out, const char* type, const std::vector<uint8_t>& data) {
+        put_u32(out, data.size());
+        size_t start = out.size();
+        out.insert(out.end(), type, type + 4);
+        out.insert(out.end(), data.begin(), data.end());
+        put_u32(out, crc32(0, &out[start], out.size() - start));
+    }
+}
+
+namespace TKPEmu::Tools {
+    std::vector<uint8_t> EncodePng(const uint8_t* rgba, uint32_t width, uint32_t height) {
+        // Every row starts with its filter type, 0 for none
+        size_t stride = size_t(width) * 4;
+        std::vector<uint8_t> raw((stride + 1) * height);
+        for (uint32_t y = 0; y < height; y++) {
+            raw[y * (stride + 1)] = 0;
+            std::memcpy(&raw[y * (stride + 1) + 1], rgba + y * stride, stride);
+        }
+        std::vector<uint8_t> header;
+        put_u32(header, width);
+        put_u32(header, height);
+        // 8 bits per channel, RGBA, deflate, adaptive filtering, no interlacing
+        header.insert(header.end(), { 8, 6, 0, 0, 0 });
+        std::vector<uint8_t> png = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+        put_chunk(png, "IHDR", header);
+        put_chunk(png, "IDAT", compress(raw));
+        put_chunk(png, "IEND", {});
+        return png;
+    }
+
+    void WritePng(const std::string& path, const uint8_t* rgba, uint32_t width, uint32_t height) {
+        auto png = EncodePng(rgba, width, height);
+        std::ofstream ofs(path, std::ios::binary);
+        if (!ofs.is_open())
+            throw ErrorFactory::generate_exception(__func__, __LINE__, "Could not open " + path);
+        ofs.write(reinterpret_cast<const char*>(png.data()), png.size());
+        if (!ofs)
+            throw ErrorFactory::generate_exception(__func__, __LINE__, "Could not write " + path);
+    }
+}
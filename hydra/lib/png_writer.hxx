@@ -0,0 +1,14 @@
+#pragma once
+#ifndef TKP_PNG_WRITER_H
+#define TKP_PNG_WRITER_H
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace TKPEmu::Tools {
+    // Encodes RGBA8888 pixels, rows top to bottom, as a PNG, compressed with zlib
+    std::vector<uint8_t> EncodePng(const uint8_t* rgba, uint32_t width, uint32_t height);
+    // Throws if the file can't be written
+    void WritePng(const std::string& path, const uint8_t* rgba, uint32_t width, uint32_t height);
+}
+#endif
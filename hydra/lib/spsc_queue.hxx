@@ -0,0 +1,56 @@
+#pragma once
+#ifndef TKP_SPSC_QUEUE_H
+#define TKP_SPSC_QUEUE_H
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+namespace TKPEmu::Tools {
+    // Lock-free bounded queue for exactly one producer thread and one consumer thread.
+    // Meant for handing display list commands from the RSP to a threaded RDP, which doesn't
+    // exist yet since the RDP lives in the N64TKP submodule. Capacity must be a power of
+    // two. Head and tail live on separate cache lines so the two sides don't keep
+    // invalidating each other's line
+    template<class T, size_t Capacity>
+    class SPSCQueue {
+        static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+    public:
+        // Returns false if the queue is full
+        bool TryPush(const T& item) {
+            size_t tail = tail_.load(std::memory_order_relaxed);
+            if (tail - head_cache_ == Capacity) {
+                head_cache_ = head_.load(std::memory_order_acquire);
+                if (tail - head_cache_ == Capacity)
+                    return false;
+            }
+            items_[tail & (Capacity - 1)] = item;
+            tail_.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+        // Returns false if the queue is empty
+        bool TryPop(T& item) {
+            size_t head = head_.load(std::memory_order_relaxed);
+            if (head == tail_cache_) {
+                tail_cache_ = tail_.load(std::memory_order_acquire);
+                if (head == tail_cache_)
+                    return false;
+            }
+            item = items_[head & (Capacity - 1)];
+            head_.store(head + 1, std::memory_order_release);
+            return true;
+        }
+        bool IsEmpty() const {
+            return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire);
+        }
+    private:
+        static constexpr size_t cache_line = 64;
+        alignas(cache_line) std::atomic<size_t> head_ = 0;
+        // Producer's last seen value of head_
+        alignas(cache_line) size_t head_cache_ = 0;
+        alignas(cache_line) std::atomic<size_t> tail_ = 0;
+        // Consumer's last seen value of tail_
+        alignas(cache_line) size_t tail_cache_ = 0;
+        alignas(cache_line) std::array<T, Capacity> items_ {};
+    };
+}
+#endif
@@ -4,6 +4,11 @@
 #include <vector>
 #include <thread>
 #include <functional>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
 
 namespace TKPEmu::Tools {
     class FixedTaskThreadPool {
@@ -39,5 +44,137 @@ namespace TKPEmu::Tools {
         std::vector<std::function<void()>> jobs_;
         std::mutex jobs_mutex_;
     };
+
+    // Threads that stay alive between jobs and sleep on an atomic while idle, for work
+    // that is split the same way every frame such as rendering in bands of scanlines
+    class WorkerPool {
+    public:
+        WorkerPool(unsigned count = std::max(1u, std::thread::hardware_concurrency())) {
+            // The calling thread acts as worker 0
+            for (unsigned i = 1; i < count; i++) {
+                threads_.push_back(std::thread(&WorkerPool::worker_loop, this, i));
+            }
+        }
+        ~WorkerPool() {
+            stopping_.store(true);
+            generation_.fetch_add(1);
+            generation_.notify_all();
+            for (auto& thread : threads_) {
+                thread.join();
+            }
+        }
+        WorkerPool(const WorkerPool&) = delete;
+        WorkerPool& operator=(const WorkerPool&) = delete;
+        unsigned GetWorkerCount() const { return threads_.size() + 1; }
+        // Runs job(worker_index) once on every worker and returns when they all finished
+        void Run(const std::function<void(unsigned)>& job) {
+            job_ = &job;
+            remaining_.store(threads_.size());
+            generation_.fetch_add(1);
+            generation_.notify_all();
+            job(0);
+            uint32_t remaining;
+            while ((remaining = remaining_.load()) != 0) {
+                remaining_.wait(remaining);
+            }
+            job_ = nullptr;
+        }
+        // Splits rows into bands of band_height rows and interleaves them across the workers,
+        // so worker w gets bands w, w + count, w + 2 * count... Calls job(first_row, last_row)
+        // with last_row exclusive. Every row is handled by exactly one worker
+        void RunBands(unsigned rows, unsigned band_height, const std::function<void(unsigned, unsigned)>& job) {
+            unsigned count = GetWorkerCount();
+            Run([&](unsigned worker) {
+                for (unsigned first = worker * band_height; first < rows; first += count * band_height) {
+                    job(first, std::min(rows, first + band_height));
+                }
+            });
+        }
+    private:
+        void worker_loop(unsigned index) {
+            uint32_t seen = 0;
+            while (true) {
+                generation_.wait(seen);
+                seen = generation_.load();
+                if (stopping_.load())
+                    return;
+                (*job_)(index);
+                if (remaining_.fetch_sub(1) == 1)
+                    remaining_.notify_one();
+            }
+        }
+        std::vector<std::thread> threads_;
+        const std::function<void(unsigned)>* job_ = nullptr;
+        std::atomic<uint32_t> generation_ = 0;
+        std::atomic<uint32_t> remaining_ = 0;
+        std::atomic_bool stopping_ = false;
+    };
+
+    // One thread running posted jobs in order, for slow work such as compression and disk
+    // I/O that the emulator thread hands off instead of waiting on
+    class BackgroundWorker {
+    public:
+        // Post refuses new jobs once max_queued are waiting, 0 means unbounded
+        BackgroundWorker(size_t max_queued = 0) : max_queued_(max_queued) {
+            thread_ = std::thread(&BackgroundWorker::worker_loop, this);
+        }
+        // Finishes the queued jobs first
+        ~BackgroundWorker() {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                stopping_ = true;
+            }
+            job_posted_.notify_one();
+            thread_.join();
+        }
+        BackgroundWorker(const BackgroundWorker&) = delete;
+        BackgroundWorker& operator=(const BackgroundWorker&) = delete;
+        // Returns false if the queue is full and the job was not queued
+        bool Post(std::function<void()> job) {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (max_queued_ && jobs_.size() >= max_queued_)
+                    return false;
+                jobs_.push_back(std::move(job));
+            }
+            job_posted_.notify_one();
+            return true;
+        }
+        // Blocks until every job posted so far has finished
+        void WaitIdle() {
+            std::unique_lock<std::mutex> lock(mutex_);
+            idle_.wait(lock, [this]() { return jobs_.empty() && !busy_; });
+        }
+        size_t GetQueuedCount() {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return jobs_.size();
+        }
+    private:
+        void worker_loop() {
+            std::unique_lock<std::mutex> lock(mutex_);
+            while (true) {
+                job_posted_.wait(lock, [this]() { return stopping_ || !jobs_.empty(); });
+                if (jobs_.empty())
+                    return;
+                auto job = std::move(jobs_.front());
+                jobs_.pop_front();
+                busy_ = true;
+                lock.unlock();
+                job();
+                lock.lock();
+                busy_ = false;
+                if (jobs_.empty())
+                    idle_.notify_all();
+            }
+        }
+        std::thread thread_;
+        std::mutex mutex_;
+        std::condition_variable job_posted_;
+        std::condition_variable idle_;
+        std::deque<std::function<void()>> jobs_;
+        size_t max_queued_;
+        bool busy_ = false;
+        bool stopping_ = false;
+    };
 }
 #endif
\ No newline at end of file
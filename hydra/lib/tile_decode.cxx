@@ -0,0 +1,136 @@
+#include "tile_decode.hxx"
+#include <cstring>
+#include <initializer_list>
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define TKP_HAS_X86_TARGETS
+#include <immintrin.h>
+#endif
+
+namespace {
+    using TKPEmu::Tools::TileDecodeOps;
+    using TKPEmu::Tools::TileBackend;
+
+    namespace scalar {
+        void decode_rows(const uint8_t* rows, size_t count, uint8_t* out) {
+            for (size_t row = 0; row < count; row++) {
+                uint8_t low = rows[row * 2];
+                uint8_t high = rows[row * 2 + 1];
+                for (int i = 0; i < 8; i++)
+                    out[row * 8 + i] = ((low >> (7 - i)) & 1) | (((high >> (7 - i)) & 1) << 1);
+            }
+        }
+        void decode_rows_flipped(const uint8_t* rows, size_t count, uint8_t* out) {
+            for (size_t row = 0; row < count; row++) {
+                uint8_t low = rows[row * 2];
+                uint8_t high = rows[row * 2 + 1];
+                for (int i = 0; i < 8; i++)
+                    out[row * 8 + i] = ((low >> i) & 1) | (((high >> i) & 1) << 1);
+            }
+        }
+        constexpr TileDecodeOps ops {
+            .Backend = TileBackend::Scalar,
+            .DecodeRows = decode_rows,
+            .DecodeRowsFlipped = decode_rows_flipped,
+        };
+    }
+
+    #ifdef TKP_HAS_X86_TARGETS
+    // Two rows per register: pshufb broadcasts each plane byte to the 8 lanes of its row,
+    // then every lane keeps the one bit it owns
+    namespace ssse3 {
+        template<bool Flipped>
+        __attribute__((target("ssse3")))
+        void decode(const uint8_t* rows, size_t count, uint8_t* out) {
+            const __m128i low_shuffle = _mm_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 2, 2, 2, 2, 2, 2, 2, 2);
+            const __m128i high_shuffle = _mm_setr_epi8(1, 1, 1, 1, 1, 1, 1, 1, 3, 3, 3, 3, 3, 3, 3, 3);
+            const __m128i bits = Flipped ?
+                _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128) :
+                _mm_setr_epi8(-128, 64, 32, 16, 8, 4, 2, 1, -128, 64, 32, 16, 8, 4, 2, 1);
+            const __m128i one = _mm_set1_epi8(1);
+            size_t row = 0;
+            for (; row + 2 <= count; row += 2) {
+                uint32_t pair;
+                std::memcpy(&pair, rows + row * 2, 4);
+                __m128i planes = _mm_cvtsi32_si128(pair);
+                __m128i low = _mm_shuffle_epi8(planes, low_shuffle);
+                __m128i high = _mm_shuffle_epi8(planes, high_shuffle);
+                low = _mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(low, bits), bits), one);
+                high = _mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(high, bits), bits), one);
+                __m128i pixels = _mm_or_si128(low, _mm_add_epi8(high, high));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + row * 8), pixels);
+            }
+            if (row < count) {
+                if (Flipped)
+                    scalar::decode_rows_flipped(rows + row * 2, count - row, out + row * 8);
+                else
+                    scalar::decode_rows(rows + row * 2, count - row, out + row * 8);
+            }
+        }
+        constexpr TileDecodeOps ops {
+            .Backend = TileBackend::SSSE3,
+            .DecodeRows = decode<false>,
+            .DecodeRowsFlipped = decode<true>,
+        };
+    }
+
+    // pdep spreads each plane's bits to one per byte, bit 0 ending up in byte 0. That is
+    // the flipped order, a byte swap gives the normal one
+    #ifdef __x86_64__
+    namespace bmi2 {
+        template<bool Flipped>
+        __attribute__((target("bmi2")))
+        void decode(const uint8_t* rows, size_t count, uint8_t* out) {
+            for (size_t row = 0; row < count; row++) {
+                uint64_t pixels = _pdep_u64(rows[row * 2], 0x0101010101010101) |
+                    _pdep_u64(rows[row * 2 + 1], 0x0202020202020202);
+                if (!Flipped)
+                    pixels = __builtin_bswap64(pixels);
+                std::memcpy(out + row * 8, &pixels, 8);
+            }
+        }
+        constexpr TileDecodeOps ops {
+            .Backend = TileBackend::BMI2,
+            .DecodeRows = decode<false>,
+            .DecodeRowsFlipped = decode<true>,
+        };
+    }
+    #endif
+    #endif
+}
+
+namespace TKPEmu::Tools {
+    const TileDecodeOps* GetTileDecodeOps(TileBackend backend) {
+        switch (backend) {
+            case TileBackend::Scalar: {
+                return &scalar::ops;
+            }
+            case TileBackend::SSSE3: {
+                #ifdef TKP_HAS_X86_TARGETS
+                if (__builtin_cpu_supports("ssse3"))
+                    return &ssse3::ops;
+                #endif
+                return nullptr;
+            }
+            case TileBackend::BMI2: {
+                #if defined(TKP_HAS_X86_TARGETS) && defined(__x86_64__)
+                if (__builtin_cpu_supports("bmi2"))
+                    return &bmi2::ops;
+                #endif
+                return nullptr;
+            }
+        }
+        return nullptr;
+    }
+
+    const TileDecodeOps& GetTileDecodeOps() {
+        // pdep is microcoded and slow on AMD before Zen 3, so pshufb goes first
+        static const TileDecodeOps* ops = []() {
+            for (auto backend : { TileBackend::SSSE3, TileBackend::BMI2 }) {
+                if (auto* ops = GetTileDecodeOps(backend))
+                    return ops;
+            }
+            return &scalar::ops;
+        }();
+        return *ops;
+    }
+}
@@ -0,0 +1,30 @@
+#pragma once
+#ifndef TKP_TILE_DECODE_H
+#define TKP_TILE_DECODE_H
+#include <cstddef>
+#include <cstdint>
+
+namespace TKPEmu::Tools {
+    enum class TileBackend {
+        Scalar,
+        SSSE3,
+        BMI2,
+    };
+
+    // Decoding of 2bpp planar tile rows, as used by the Game Boy and NES PPUs.
+    // A row is two bytes, the low bitplane followed by the high one, with the leftmost
+    // pixel in bit 7. Every backend produces identical results, the scalar one is the reference
+    struct TileDecodeOps {
+        TileBackend Backend;
+        // Decodes count rows into 8 color indices (0-3) per row, leftmost pixel first
+        void (*DecodeRows)(const uint8_t* rows, size_t count, uint8_t* out);
+        // Same as DecodeRows with every row mirrored horizontally, for flipped sprites
+        void (*DecodeRowsFlipped)(const uint8_t* rows, size_t count, uint8_t* out);
+    };
+
+    // Picks the fastest backend the host CPU supports. Checked once, at first call
+    const TileDecodeOps& GetTileDecodeOps();
+    // Returns nullptr if the backend isn't available on this host
+    const TileDecodeOps* GetTileDecodeOps(TileBackend backend);
+}
+#endif
@@ -0,0 +1,318 @@
+#include "upscale.hxx"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <include/error_factory.hxx>
+#if defined(__SSE2__) || defined(_M_X64)
+#define TKP_UPSCALE_SSE
+#include <emmintrin.h>
+#endif
+
+namespace {
+    // Rows per job, small enough that every worker gets several bands of a 240 line frame
+    constexpr unsigned band_height = 16;
+
+    inline uint32_t pixel(const uint32_t* src, int width, int height, int x, int y) {
+        x = std::clamp(x, 0, width - 1);
+        y = std::clamp(y, 0, height - 1);
+        return src[y * width + x];
+    }
+
+    // Copies the first row of a block of factor rows to the rest
+    inline void repeat_row(uint32_t* row, size_t length, int factor) {
+        for (int i = 1; i < factor; i++)
+            std::memcpy(row + i * length, row, length * sizeof(uint32_t));
+    }
+
+    void nearest(const uint32_t* src, int width, int factor, uint32_t* dst, int first, int last) {
+        size_t out_width = size_t(width) * factor;
+        for (int y = first; y < last; y++) {
+            const uint32_t* in = src + y * width;
+            uint32_t* out = dst + size_t(y) * factor * out_width;
+            int x = 0;
+            #ifdef TKP_UPSCALE_SSE
+            if (factor == 2) {
+                for (; x + 4 <= width; x += 4) {
+                    __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + x));
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x * 2), _mm_unpacklo_epi32(p, p));
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x * 2 + 4), _mm_unpackhi_epi32(p, p));
+                }
+            } else if (factor == 4) {
+                for (; x + 4 <= width; x += 4) {
+                    __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + x));
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x * 4), _mm_shuffle_epi32(p, 0x00));
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x * 4 + 4), _mm_shuffle_epi32(p, 0x55));
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x * 4 + 8), _mm_shuffle_epi32(p, 0xAA));
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x * 4 + 12), _mm_shuffle_epi32(p, 0xFF));
+                }
+            }
+            #endif
+            for (; x < width; x++) {
+                for (int i = 0; i < factor; i++)
+                    out[x * factor + i] = in[x];
+            }
+            repeat_row(out, out_width, factor);
+        }
+    }
+
+    inline void scale2x_pixel(const uint32_t* src, int width, int height, int x, int y, uint32_t* out0, uint32_t* out1) {
+        uint32_t b = pixel(src, width, height, x, y - 1);
+        uint32_t d = pixel(src, width, height, x - 1, y);
+        uint32_t e = pixel(src, width, height, x, y);
+        uint32_t f = pixel(src, width, height, x + 1, y);
+        uint32_t h = pixel(src, width, height, x, y + 1);
+        if (b != h && d != f) {
+            out0[0] = d == b ? d : e;
+            out0[1] = b == f ? f : e;
+            out1[0] = d == h ? d : e;
+            out1[1] = h == f ? f : e;
+        } else {
+            out0[0] = out0[1] = out1[0] = out1[1] = e;
+        }
+    }
+
+    #ifdef TKP_UPSCALE_SSE
+    inline __m128i select(__m128i mask, __m128i a, __m128i b) {
+        return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+    }
+    #endif
+
+    void scale2x(const uint32_t* src, int width, int height, uint32_t* dst, int first, int last) {
+        size_t out_width = size_t(width) * 2;
+        for (int y = first; y < last; y++) {
+            uint32_t* out0 = dst + size_t(y) * 2 * out_width;
+            uint32_t* out1 = out0 + out_width;
+            // The first and last columns need their neighbours clamped
+            scale2x_pixel(src, width, height, 0, y, out0, out1);
+            int x = 1;
+            #ifdef TKP_UPSCALE_SSE
+            const uint32_t* above = src + std::max(y - 1, 0) * width;
+            const uint32_t* row = src + y * width;
+            const uint32_t* below = src + std::min(y + 1, height - 1) * width;
+            for (; x + 4 < width; x += 4) {
+                __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(above + x));
+                __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x - 1));
+                __m128i e = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x));
+                __m128i f = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x + 1));
+                __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(below + x));
+                // Lanes where b != h and d != f
+                __m128i active = _mm_andnot_si128(_mm_or_si128(_mm_cmpeq_epi32(b, h), _mm_cmpeq_epi32(d, f)), _mm_set1_epi32(-1));
+                __m128i e0 = select(_mm_and_si128(active, _mm_cmpeq_epi32(d, b)), d, e);
+                __m128i e1 = select(_mm_and_si128(active, _mm_cmpeq_epi32(b, f)), f, e);
+                __m128i e2 = select(_mm_and_si128(active, _mm_cmpeq_epi32(d, h)), d, e);
+                __m128i e3 = select(_mm_and_si128(active, _mm_cmpeq_epi32(h, f)), f, e);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out0 + x * 2), _mm_unpacklo_epi32(e0, e1));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out0 + x * 2 + 4), _mm_unpackhi_epi32(e0, e1));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out1 + x * 2), _mm_unpacklo_epi32(e2, e3));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out1 + x * 2 + 4), _mm_unpackhi_epi32(e2, e3));
+            }
+            #endif
+            for (; x < width; x++)
+                scale2x_pixel(src, width, height, x, y, out0 + x * 2, out1 + x * 2);
+        }
+    }
+
+    void scale3x(const uint32_t* src, int width, int height, uint32_t* dst, int first, int last) {
+        size_t out_width = size_t(width) * 3;
+        for (int y = first; y < last; y++) {
+            uint32_t* out0 = dst + size_t(y) * 3 * out_width;
+            uint32_t* out1 = out0 + out_width;
+            uint32_t* out2 = out1 + out_width;
+            for (int x = 0; x < width; x++) {
+                uint32_t a = pixel(src, width, height, x - 1, y - 1);
+                uint32_t b = pixel(src, width, height, x, y - 1);
+                uint32_t c = pixel(src, width, height, x + 1, y - 1);
+                uint32_t d = pixel(src, width, height, x - 1, y);
+                uint32_t e = pixel(src, width, height, x, y);
+                uint32_t f = pixel(src, width, height, x + 1, y);
+                uint32_t g = pixel(src, width, height, x - 1, y + 1);
+                uint32_t h = pixel(src, width, height, x, y + 1);
+                uint32_t i = pixel(src, width, height, x + 1, y + 1);
+                uint32_t* o0 = out0 + x * 3;
+                uint32_t* o1 = out1 + x * 3;
+                uint32_t* o2 = out2 + x * 3;
+                if (b != h && d != f) {
+                    o0[0] = d == b ? d : e;
+                    o0[1] = (d == b && e != c) || (b == f && e != a) ? b : e;
+                    o0[2] = b == f ? f : e;
+                    o1[0] = (d == b && e != g) || (d == h && e != a) ? d : e;
+                    o1[1] = e;
+                    o1[2] = (b == f && e != i) || (h == f && e != c) ? f : e;
+                    o2[0] = d == h ? d : e;
+                    o2[1] = (d == h && e != i) || (h == f && e != g) ? h : e;
+                    o2[2] = h == f ? f : e;
+                } else {
+                    o0[0] = o0[1] = o0[2] = o1[0] = o1[1] = o1[2] = o2[0] = o2[1] = o2[2] = e;
+                }
+            }
+        }
+    }
+
+    // xBR reads two pixels past every edge, so it works on a copy of the frame with a clamped
+    // border of this size, which keeps bounds checks out of the inner loop
+    constexpr int xbr_border = 2;
+
+    // Copies rows [first, last) into the bordered frame and converts them to YUV, Y in the
+    // low byte then U and V, from the RGBA bytes in memory order
+    void xbr_prepare(const uint32_t* src, int width, int height, uint32_t* padded, uint32_t* yuv, int first, int last) {
+        int stride = width + xbr_border * 2;
+        int padded_first = first == 0 ? 0 : first + xbr_border;
+        int padded_last = last == height ? height + xbr_border * 2 : last + xbr_border;
+        for (int py = padded_first; py < padded_last; py++) {
+            const uint32_t* in = src + std::clamp(py - xbr_border, 0, height - 1) * width;
+            for (int px = 0; px < stride; px++) {
+                uint32_t color = in[std::clamp(px - xbr_border, 0, width - 1)];
+                int r = color & 0xFF;
+                int g = (color >> 8) & 0xFF;
+                int b = (color >> 16) & 0xFF;
+                uint32_t y = (77 * r + 150 * g + 29 * b) >> 8;
+                uint32_t u = std::clamp(((-43 * r - 85 * g + 128 * b) >> 8) + 128, 0, 255);
+                uint32_t v = std::clamp(((128 * r - 107 * g - 21 * b) >> 8) + 128, 0, 255);
+                padded[py * stride + px] = color;
+                yuv[py * stride + px] = y | (u << 8) | (v << 16);
+            }
+        }
+    }
+
+    // Luma differences count the most, like in the reference xBR shaders
+    inline int distance(uint32_t a, uint32_t b) {
+        return 48 * std::abs(int(a & 0xFF) - int(b & 0xFF)) +
+            7 * std::abs(int((a >> 8) & 0xFF) - int((b >> 8) & 0xFF)) +
+            6 * std::abs(int((a >> 16) & 0xFF) - int((b >> 16) & 0xFF));
+    }
+
+    inline uint32_t average(uint32_t a, uint32_t b) {
+        return (a & b) + (((a ^ b) & 0xFEFEFEFE) >> 1);
+    }
+
+    // Neighbourhood offsets for the bottom right corner. The other three corners use the
+    // same rule on the neighbourhood rotated by 90 degrees each time
+    struct Offset { int X, Y; };
+    enum { B, C, D, F, G, H, I, F4, I4, H5, I5, NeighbourCount };
+    constexpr Offset neighbours[NeighbourCount] = {
+        { 0, -1 }, { 1, -1 }, { -1, 0 }, { 1, 0 }, { -1, 1 }, { 0, 1 }, { 1, 1 },
+        { 2, 0 }, { 2, 1 }, { 0, 2 }, { 1, 2 },
+    };
+    // Bottom right, bottom left, top left, top right
+    constexpr int corner_x[4] = { 1, 0, 0, 1 };
+    constexpr int corner_y[4] = { 1, 1, 0, 0 };
+
+    void xbr2x(const uint32_t* padded, const uint32_t* yuv, int width, uint32_t* dst, int first, int last) {
+        int stride = width + xbr_border * 2;
+        int offsets[4][NeighbourCount];
+        for (int corner = 0; corner < 4; corner++) {
+            for (int n = 0; n < NeighbourCount; n++) {
+                int dx = neighbours[n].X, dy = neighbours[n].Y;
+                for (int r = 0; r < corner; r++) {
+                    int t = dx;
+                    dx = -dy;
+                    dy = t;
+                }
+                offsets[corner][n] = dy * stride + dx;
+            }
+        }
+        size_t out_width = size_t(width) * 2;
+        for (int y = first; y < last; y++) {
+            const uint32_t* p = padded + (y + xbr_border) * stride + xbr_border;
+            const uint32_t* q = yuv + (y + xbr_border) * stride + xbr_border;
+            for (int x = 0; x < width; x++, p++, q++) {
+                uint32_t e = p[0];
+                for (int corner = 0; corner < 4; corner++) {
+                    const int* o = offsets[corner];
+                    uint32_t result = e;
+                    // Flat areas are most of a frame and never blend
+                    if (e != p[o[F]] && e != p[o[H]]) {
+                        // Weight of an edge along F-H against one along E-I
+                        int along_fh = distance(q[0], q[o[C]]) + distance(q[0], q[o[G]]) + distance(q[o[I]], q[o[F4]]) +
+                            distance(q[o[I]], q[o[H5]]) + 4 * distance(q[o[H]], q[o[F]]);
+                        int along_ei = distance(q[o[H]], q[o[D]]) + distance(q[o[H]], q[o[I5]]) + distance(q[o[F]], q[o[I4]]) +
+                            distance(q[o[F]], q[o[B]]) + 4 * distance(q[0], q[o[I]]);
+                        if (along_fh < along_ei) {
+                            uint32_t blend = distance(q[0], q[o[F]]) <= distance(q[0], q[o[H]]) ? p[o[F]] : p[o[H]];
+                            result = average(e, blend);
+                        }
+                    }
+                    dst[(size_t(y) * 2 + corner_y[corner]) * out_width + x * 2 + corner_x[corner]] = result;
+                }
+            }
+        }
+    }
+}
+
+namespace TKPEmu::Tools {
+    int GetUpscaleFactor(UpscaleFilter filter) {
+        switch (filter) {
+            case UpscaleFilter::Nearest2x:
+            case UpscaleFilter::Scale2x:
+            case UpscaleFilter::XBR2x:
+                return 2;
+            case UpscaleFilter::Nearest3x:
+            case UpscaleFilter::Scale3x:
+                return 3;
+            case UpscaleFilter::Nearest4x:
+            case UpscaleFilter::Scale4x:
+            case UpscaleFilter::XBR4x:
+                return 4;
+        }
+        throw ErrorFactory::generate_exception(__func__, __LINE__, "Unknown upscale filter");
+    }
+
+    const uint32_t* Upscaler::Process(const uint32_t* src, int width, int height, UpscaleFilter filter) {
+        switch (filter) {
+            case UpscaleFilter::Scale4x:
+                run(src, width, height, UpscaleFilter::Scale2x, intermediate_);
+                run(intermediate_.data(), width * 2, height * 2, UpscaleFilter::Scale2x, out_);
+                break;
+            case UpscaleFilter::XBR4x:
+                run(src, width, height, UpscaleFilter::XBR2x, intermediate_);
+                run(intermediate_.data(), width * 2, height * 2, UpscaleFilter::XBR2x, out_);
+                break;
+            default:
+                run(src, width, height, filter, out_);
+                break;
+        }
+        return out_.data();
+    }
+
+    void Upscaler::run(const uint32_t* src, int width, int height, UpscaleFilter filter, std::vector<uint32_t>& dst) {
+        int factor = GetUpscaleFactor(filter);
+        dst.resize(size_t(width) * height * factor * factor);
+        uint32_t* out = dst.data();
+        switch (filter) {
+            case UpscaleFilter::Nearest2x:
+            case UpscaleFilter::Nearest3x:
+            case UpscaleFilter::Nearest4x:
+                pool_.RunBands(height, band_height, [&](unsigned first, unsigned last) {
+                    nearest(src, width, factor, out, first, last);
+                });
+                break;
+            case UpscaleFilter::Scale2x:
+                pool_.RunBands(height, band_height, [&](unsigned first, unsigned last) {
+                    scale2x(src, width, height, out, first, last);
+                });
+                break;
+            case UpscaleFilter::Scale3x:
+                pool_.RunBands(height, band_height, [&](unsigned first, unsigned last) {
+                    scale3x(src, width, height, out, first, last);
+                });
+                break;
+            case UpscaleFilter::XBR2x: {
+                // Bands read their neighbours' rows, so every row has to be prepared first
+                size_t padded_size = size_t(width + xbr_border * 2) * (height + xbr_border * 2);
+                padded_.resize(padded_size);
+                yuv_.resize(padded_size);
+                uint32_t* padded = padded_.data();
+                uint32_t* yuv = yuv_.data();
+                pool_.RunBands(height, band_height, [&](unsigned first, unsigned last) {
+                    xbr_prepare(src, width, height, padded, yuv, first, last);
+                });
+                pool_.RunBands(height, band_height, [&](unsigned first, unsigned last) {
+                    xbr2x(padded, yuv, width, out, first, last);
+                });
+                break;
+            }
+            default:
+                throw ErrorFactory::generate_exception(__func__, __LINE__, "Filter needs more than one pass");
+        }
+    }
+}
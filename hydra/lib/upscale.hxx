@@ -0,0 +1,43 @@
+#pragma once
+#ifndef TKP_UPSCALE_H
+#define TKP_UPSCALE_H
+#include <cstdint>
+#include <vector>
+#include "threadpool.hxx"
+
+namespace TKPEmu::Tools {
+    enum class UpscaleFilter {
+        Nearest2x,
+        Nearest3x,
+        Nearest4x,
+        Scale2x,
+        Scale3x,
+        // Scale2x applied twice, which is how Scale4x is defined
+        Scale4x,
+        // xBR level 1: edges are found by comparing weighted YUV distances along both
+        // diagonals of a 5x5 neighbourhood and the corner on the smooth side is blended
+        XBR2x,
+        XBR4x,
+    };
+
+    int GetUpscaleFactor(UpscaleFilter filter);
+
+    // Upscales RGBA8888 frames on the CPU for hosts without a GPU. Every pass is split into
+    // bands of rows across the worker pool, nearest and Scale2x use SSE2 on x86
+    class Upscaler {
+    public:
+        Upscaler(WorkerPool& pool) : pool_(pool) {}
+        // Returns width * factor by height * factor pixels, valid until the next call
+        const uint32_t* Process(const uint32_t* src, int width, int height, UpscaleFilter filter);
+    private:
+        void run(const uint32_t* src, int width, int height, UpscaleFilter filter, std::vector<uint32_t>& dst);
+        WorkerPool& pool_;
+        std::vector<uint32_t> out_;
+        // Output of the first pass of the 4x filters
+        std::vector<uint32_t> intermediate_;
+        // Source with a clamped border, and its luma and chroma, computed once per xBR pass
+        std::vector<uint32_t> padded_;
+        std::vector<uint32_t> yuv_;
+    };
+}
+#endif
@@ -0,0 +1,58 @@
+#include "vector_lanes.hxx"
+
+namespace {
+    using TKPEmu::Tools::VectorLaneOps;
+    using TKPEmu::Tools::VectorBackend;
+    using TKPEmu::Tools::VectorKernels;
+
+    template<class Kernels>
+    constexpr VectorLaneOps make_ops() {
+        return {
+            .Backend = Kernels::Backend,
+            .AddSaturate = Kernels::AddSaturate,
+            .SubSaturate = Kernels::SubSaturate,
+            .Add = Kernels::Add,
+            .Sub = Kernels::Sub,
+            .MulLow = Kernels::MulLow,
+            .MulHigh = Kernels::MulHigh,
+            .MulHighUnsigned = Kernels::MulHighUnsigned,
+            .And = Kernels::And,
+            .Or = Kernels::Or,
+            .Xor = Kernels::Xor,
+            .CompareLess = Kernels::CompareLess,
+            .CompareEqual = Kernels::CompareEqual,
+            .Select = Kernels::Select,
+        };
+    }
+
+    constexpr VectorLaneOps scalar_ops = make_ops<VectorKernels<VectorBackend::Scalar>>();
+    #ifdef TKP_VECTOR_LANES_SSE2
+    constexpr VectorLaneOps sse2_ops = make_ops<VectorKernels<VectorBackend::SSE2>>();
+    #endif
+}
+
+namespace TKPEmu::Tools {
+    const VectorLaneOps* GetVectorLaneOps(VectorBackend backend) {
+        switch (backend) {
+            case VectorBackend::Scalar: {
+                return &scalar_ops;
+            }
+            case VectorBackend::SSE2: {
+                #ifdef TKP_VECTOR_LANES_SSE2
+                return &sse2_ops;
+                #else
+                return nullptr;
+                #endif
+            }
+        }
+        return nullptr;
+    }
+
+    const VectorLaneOps& GetVectorLaneOps() {
+        #ifdef TKP_VECTOR_LANES_SSE2
+        return sse2_ops;
+        #else
+        return scalar_ops;
+        #endif
+    }
+}
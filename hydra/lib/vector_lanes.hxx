@@ -0,0 +1,155 @@
+#pragma once
+#ifndef TKP_VECTOR_LANES_H
+#define TKP_VECTOR_LANES_H
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#if defined(__SSE2__) || defined(_M_X64)
+#define TKP_VECTOR_LANES_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace TKPEmu::Tools {
+    // 8 lanes of 16 bits, the register shape of the N64 RSP vector unit.
+    // Lane 0 is the lowest address in memory
+    struct alignas(16) VectorLanes {
+        std::array<int16_t, 8> Lanes;
+    };
+
+    enum class VectorBackend {
+        Scalar,
+        SSE2,
+    };
+
+    // Lane-wise primitives the vector unit opcodes are built from, one specialization per
+    // backend. Every backend produces bit identical results, the scalar one is the reference.
+    // They are inline so that a block of ops written against one of them compiles to straight
+    // line code, see WithVectorBackend
+    template<VectorBackend Backend>
+    struct VectorKernels;
+
+    template<>
+    struct VectorKernels<VectorBackend::Scalar> {
+        static constexpr VectorBackend Backend = VectorBackend::Scalar;
+        // Signed saturating add and subtract
+        static void AddSaturate(VectorLanes& dst, const VectorLanes& a, const VectorLanes& b) {
+            binary(dst, a, b, [](int32_t x, int32_t y) { return std::clamp(x + y, -32768, 32767); });
+        }
+        static void SubSaturate(VectorLanes& dst, const VectorLanes& a, const VectorLanes& b) {
+            binary(dst, a, b, [](int32_t x, int32_t y) { return std::clamp(x - y, -32768, 32767); });
+        }
+        // Wrapping add and subtract
+        static void Add(VectorLanes& dst, const VectorLanes& a, const VectorLanes& b) {
+            binary(dst, a, b, [](int32_t x, int32_t y) { return x + y; });
+        }
+        static void Sub(VectorLanes& dst, const VectorLanes& a, const VectorLanes& b) {
+            binary(dst, a, b, [](int32_t x, int32_t y) { return x - y; });
+        }
+        // Low and high halves of the 32 bit signed product
+        static void MulLow(VectorLanes& dst, const VectorLanes& a, const VectorLanes& b) {
+            binary(dst, a, b, [](int32_t x, int32_t y) { return x * y; });
+        }
+        static void MulHigh(VectorLanes& dst, const VectorLanes& a, const VectorLanes& b) {
+            binary(dst, a, b, [](int32_t x, int32_t y) { return (x * y) >> 16; });
+        }
+        // High half of the 32 bit unsigned product
+        static void MulHighUnsigned(VectorLanes& dst, const VectorLanes& a, const VectorLanes& b) {
+            binary(dst, a, b, [](uint16_t x, uint16_t y) { return (uint32_t(x) * uint32_t(y)) >> 16; });
+        }
+        static void And(VectorLanes& dst, const VectorLanes& a, const VectorLanes& b) {
+            binary(dst, a, b, [](int32_t x, int32_t y) { return x & y; });
+        }
+        static void Or(VectorLanes& dst, const VectorLanes& a, const VectorLanes& b) {
+            binary(dst, a, b, [](int32_t x, int32_t y) { return x | y; });
+        }
+        static void Xor(VectorLanes& dst, const VectorLanes& a, const VectorLanes& b) {
+            binary(dst, a, b, [](int32_t x, int32_t y) { return x ^ y; });
+        }
+        // All ones in lanes where the comparison is true, signed
+        static void CompareLess(VectorLanes& dst, const VectorLanes& a, const VectorLanes& b) {
+            binary(dst, a, b, [](int32_t x, int32_t y) { return x < y ? -1 : 0; });
+        }
+        static void CompareEqual(VectorLanes& dst, const VectorLanes& a, const VectorLanes& b) {
+            binary(dst, a, b, [](int32_t x, int32_t y) { return x == y ? -1 : 0; });
+        }
+        // dst = mask ? a : b, lane by lane
+        static void Select(VectorLanes& dst, const VectorLanes& mask, const VectorLanes& a, const VectorLanes& b) {
+            for (int i = 0; i < 8; i++) {
+                dst.Lanes[i] = (a.Lanes[i] & mask.Lanes[i]) | (b.Lanes[i] & ~mask.Lanes[i]);
+            }
+        }
+    private:
+        template<class Func>
+        static void binary(VectorLanes& dst, const VectorLanes& a, const VectorLanes& b, Func func) {
+            for (int i = 0; i < 8; i++) {
+                dst.Lanes[i] = static_cast<int16_t>(func(a.Lanes[i], b.Lanes[i]));
+            }
+        }
+    };
+
+    #ifdef TKP_VECTOR_LANES_SSE2
+    template<>
+    struct VectorKernels<VectorBackend::SSE2> {
+        static constexpr VectorBackend Backend = VectorBackend::SSE2;
+        static void AddSaturate(VectorLanes& dst, const VectorLanes& a, const VectorLanes& b) { store(dst, _mm_adds_epi16(load(a), load(b))); }
+        static void SubSaturate(VectorLanes& dst, const VectorLanes& a, const VectorLanes& b) { store(dst, _mm_subs_epi16(load(a), load(b))); }
+        static void Add(VectorLanes& dst, const VectorLanes& a, const VectorLanes& b) { store(dst, _mm_add_epi16(load(a), load(b))); }
+        static void Sub(VectorLanes& dst, const VectorLanes& a, const VectorLanes& b) { store(dst, _mm_sub_epi16(load(a), load(b))); }
+        static void MulLow(VectorLanes& dst, const VectorLanes& a, const VectorLanes& b) { store(dst, _mm_mullo_epi16(load(a), load(b))); }
+        static void MulHigh(VectorLanes& dst, const VectorLanes& a, const VectorLanes& b) { store(dst, _mm_mulhi_epi16(load(a), load(b))); }
+        static void MulHighUnsigned(VectorLanes& dst, const VectorLanes& a, const VectorLanes& b) { store(dst, _mm_mulhi_epu16(load(a), load(b))); }
+        static void And(VectorLanes& dst, const VectorLanes& a, const VectorLanes& b) { store(dst, _mm_and_si128(load(a), load(b))); }
+        static void Or(VectorLanes& dst, const VectorLanes& a, const VectorLanes& b) { store(dst, _mm_or_si128(load(a), load(b))); }
+        static void Xor(VectorLanes& dst, const VectorLanes& a, const VectorLanes& b) { store(dst, _mm_xor_si128(load(a), load(b))); }
+        static void CompareLess(VectorLanes& dst, const VectorLanes& a, const VectorLanes& b) { store(dst, _mm_cmplt_epi16(load(a), load(b))); }
+        static void CompareEqual(VectorLanes& dst, const VectorLanes& a, const VectorLanes& b) { store(dst, _mm_cmpeq_epi16(load(a), load(b))); }
+        static void Select(VectorLanes& dst, const VectorLanes& mask, const VectorLanes& a, const VectorLanes& b) {
+            __m128i m = load(mask);
+            store(dst, _mm_or_si128(_mm_and_si128(m, load(a)), _mm_andnot_si128(m, load(b))));
+        }
+    private:
+        static __m128i load(const VectorLanes& v) {
+            return _mm_load_si128(reinterpret_cast<const __m128i*>(v.Lanes.data()));
+        }
+        static void store(VectorLanes& v, __m128i x) {
+            _mm_store_si128(reinterpret_cast<__m128i*>(v.Lanes.data()), x);
+        }
+    };
+    using HostVectorKernels = VectorKernels<VectorBackend::SSE2>;
+    #else
+    using HostVectorKernels = VectorKernels<VectorBackend::Scalar>;
+    #endif
+
+    // Runs block.template operator()<Kernels>() with the kernels of the best backend the
+    // build targets. The backend is picked once for the whole block instead of once per op,
+    // so interpreters should wrap a full instruction, or a run of them, in one call
+    template<class Block>
+    decltype(auto) WithVectorBackend(Block&& block) {
+        return block.template operator()<HostVectorKernels>();
+    }
+
+    // The same primitives behind function pointers, for callers that pick a backend at
+    // runtime. Each op is an indirect call, so prefer WithVectorBackend in hot loops
+    struct VectorLaneOps {
+        VectorBackend Backend;
+        void (*AddSaturate)(VectorLanes& dst, const VectorLanes& a, const VectorLanes& b);
+        void (*SubSaturate)(VectorLanes& dst, const VectorLanes& a, const VectorLanes& b);
+        void (*Add)(VectorLanes& dst, const VectorLanes& a, const VectorLanes& b);
+        void (*Sub)(VectorLanes& dst, const VectorLanes& a, const VectorLanes& b);
+        void (*MulLow)(VectorLanes& dst, const VectorLanes& a, const VectorLanes& b);
+        void (*MulHigh)(VectorLanes& dst, const VectorLanes& a, const VectorLanes& b);
+        void (*MulHighUnsigned)(VectorLanes& dst, const VectorLanes& a, const VectorLanes& b);
+        void (*And)(VectorLanes& dst, const VectorLanes& a, const VectorLanes& b);
+        void (*Or)(VectorLanes& dst, const VectorLanes& a, const VectorLanes& b);
+        void (*Xor)(VectorLanes& dst, const VectorLanes& a, const VectorLanes& b);
+        void (*CompareLess)(VectorLanes& dst, const VectorLanes& a, const VectorLanes& b);
+        void (*CompareEqual)(VectorLanes& dst, const VectorLanes& a, const VectorLanes& b);
+        void (*Select)(VectorLanes& dst, const VectorLanes& mask, const VectorLanes& a, const VectorLanes& b);
+    };
+
+    // The table of the best backend the build targets, the same one WithVectorBackend uses
+    const VectorLaneOps& GetVectorLaneOps();
+    // Returns nullptr if the backend wasn't compiled in
+    const VectorLaneOps* GetVectorLaneOps(VectorBackend backend);
+}
+#endif
@@ -9,6 +9,7 @@
 #include <QKeyEvent>
 #include <QApplication>
 #include <QClipboard>
+#include <QDateTime>
 #include <QGridLayout>
 #include <QGroupBox>
 #include <iostream>
@@ -22,11 +23,17 @@
     return; \
 }
 
+namespace {
+    // Milliseconds between SDL polls with and without a controller open
+    constexpr int controller_active_interval = 1;
+    constexpr int controller_idle_interval = 250;
+}
+
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
 {
     setup_emulator_specific();
-    if(SDL_Init(SDL_INIT_AUDIO) != 0) [[unlikely]] {
+    if(SDL_Init(SDL_INIT_AUDIO | SDL_INIT_GAMECONTROLLER) != 0) [[unlikely]] {
         SDL_Log("Failed to initialize SDL: %s", SDL_GetError());
         exit(1);
     }
@@ -35,16 +42,15 @@ MainWindow::MainWindow(QWidget *parent)
     QVBoxLayout *layout = new QVBoxLayout;
     layout->setAlignment(Qt::AlignHCenter);
     layout->setContentsMargins(5, 5, 5, 5);
-    lbl_ = new QLabel(this);
-    lbl_->setScaledContents(false);
-    lbl_->setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Expanding);
-    lbl_->setAlignment(Qt::AlignHCenter | Qt::AlignVCenter);
-    layout->addWidget(lbl_);
+    screen_ = new ScreenWidget(this);
+    layout->addWidget(screen_);
     widget->setLayout(layout);
     create_actions();
     create_menus();
     QString message = tr("A context menu is available by right-clicking");
     statusBar()->showMessage(message);
+    present_stats_label_ = new QLabel(this);
+    statusBar()->addPermanentWidget(present_stats_label_);
     setMinimumSize(160, 160);
     resize(640, 480);
     setWindowTitle("hydra");
@@ -53,13 +59,20 @@ MainWindow::MainWindow(QWidget *parent)
     QTimer *timer = new QTimer;
     timer->start(16);
     connect(timer, SIGNAL(timeout()), this, SLOT(redraw_screen()));
+    QTimer *stats_timer = new QTimer(this);
+    stats_timer->start(1000);
+    connect(stats_timer, SIGNAL(timeout()), this, SLOT(update_present_stats()));
+    // Polled separately from the redraws so controller input isn't delayed by up to a frame
+    controller_timer_ = new QTimer(this);
+    controller_timer_->start(controller_idle_interval);
+    connect(controller_timer_, SIGNAL(timeout()), this, SLOT(poll_controllers()));
 
     enable_emulation_actions(false);
 }
 
 MainWindow::~MainWindow() {
     stop_emulator();
-    SDL_QuitSubSystem(SDL_INIT_AUDIO);
+    SDL_QuitSubSystem(SDL_INIT_AUDIO | SDL_INIT_GAMECONTROLLER);
     SDL_Quit();
 }
 
@@ -87,8 +100,34 @@ void MainWindow::create_actions() {
     connect(reset_act_, &QAction::triggered, this, &MainWindow::reset_emulator);
     screenshot_act_ = new QAction(tr("S&creenshot"), this);
     screenshot_act_->setShortcut(Qt::Key_F12);
-    screenshot_act_->setStatusTip(tr("Take a screenshot (check settings for save path)"));
+    screenshot_act_->setStatusTip(tr("Take a screenshot (saved in the screenshots folder next to the settings)"));
     connect(screenshot_act_, &QAction::triggered, this, &MainWindow::screenshot);
+    record_act_ = new QAction(tr("Record &input"), this);
+    record_act_->setCheckable(true);
+    record_act_->setStatusTip(tr("Reset the emulator and record inputs to a movie file"));
+    connect(record_act_, &QAction::triggered, this, &MainWindow::record_movie);
+    record_video_act_ = new QAction(tr("Record &video"), this);
+    record_video_act_->setCheckable(true);
+    record_video_act_->setStatusTip(tr("Record video and audio (saved in the recordings folder next to the settings)"));
+    connect(record_video_act_, &QAction::triggered, this, &MainWindow::record_video);
+    filter_group_ = new QActionGroup(this);
+    const std::pair<QString, std::optional<TKPEmu::Tools::UpscaleFilter>> filters[] = {
+        { tr("&None"), std::nullopt },
+        { tr("Nearest &2x"), TKPEmu::Tools::UpscaleFilter::Nearest2x },
+        { tr("Nearest &3x"), TKPEmu::Tools::UpscaleFilter::Nearest3x },
+        { tr("Nearest &4x"), TKPEmu::Tools::UpscaleFilter::Nearest4x },
+        { tr("Scale2x"), TKPEmu::Tools::UpscaleFilter::Scale2x },
+        { tr("Scale3x"), TKPEmu::Tools::UpscaleFilter::Scale3x },
+        { tr("Scale4x"), TKPEmu::Tools::UpscaleFilter::Scale4x },
+        { tr("xBR 2x"), TKPEmu::Tools::UpscaleFilter::XBR2x },
+        { tr("xBR 4x"), TKPEmu::Tools::UpscaleFilter::XBR4x },
+    };
+    for (const auto& [name, filter] : filters) {
+        auto* act = filter_group_->addAction(name);
+        act->setCheckable(true);
+        act->setChecked(!filter);
+        connect(act, &QAction::triggered, this, [this, filter = filter]() { set_upscale_filter(filter); });
+    }
     about_act_ = new QAction(tr("&About"), this);
     about_act_->setShortcut(QKeySequence::HelpContents);
     about_act_->setStatusTip(tr("Show about dialog"));
@@ -110,12 +149,17 @@ void MainWindow::create_menus() {
     file_menu_->addAction(open_act_);
     file_menu_->addSeparator();
     file_menu_->addAction(screenshot_act_);
+    file_menu_->addAction(record_act_);
+    file_menu_->addAction(record_video_act_);
     file_menu_->addSeparator();
     file_menu_->addAction(settings_act_);
     emulation_menu_ = menuBar()->addMenu(tr("&Emulation"));
     emulation_menu_->addAction(pause_act_);
     emulation_menu_->addAction(reset_act_);
     emulation_menu_->addAction(stop_act_);
+    emulation_menu_->addSeparator();
+    auto* filter_menu = emulation_menu_->addMenu(tr("&Filter"));
+    filter_menu->addActions(filter_group_->actions());
     tools_menu_ = menuBar()->addMenu(tr("&Tools"));
     tools_menu_->addAction(debugger_act_);
     tools_menu_->addAction(tracelogger_act_);
@@ -125,12 +169,12 @@ void MainWindow::create_menus() {
 
 void MainWindow::keyPressEvent(QKeyEvent *event) {
     if (emulator_)
-        emulator_->HandleKeyDown(event->key());
+        emulator_->KeyDown(event->key());
 }
 
 void MainWindow::keyReleaseEvent(QKeyEvent *event) {
     if (emulator_)
-        emulator_->HandleKeyUp(event->key());
+        emulator_->KeyUp(event->key());
 }
 
 void MainWindow::open_file() {
@@ -170,15 +214,9 @@ void MainWindow::open_file() {
         if (!emulator_->LoadFromFile(path))
             throw ErrorFactory::generate_exception(__func__, __LINE__, "Failed to open ROM");
         message_queue_ = emulator_->MessageQueue;
-        const auto& data = TKPEmu::EmulatorFactory::GetEmulatorData();
-        emulator_->SetWidth(data[static_cast<int>(type)].DefaultWidth);
-        emulator_->SetHeight(data[static_cast<int>(type)].DefaultHeight);
-        emulator_->Paused = pause_act_->isChecked();
-        auto func = [&]() {
-            emulator_->Start();
-        };
-        emulator_thread_ = std::thread(func);
-        emulator_thread_.detach();
+        if (pause_act_->isChecked())
+            emulator_->Pause();
+        emulator_runner_.Start(emulator_);
         emulator_type_ = type;
         enable_emulation_actions(true);
         for (int i = 0; i < emulator_tools_.size(); i++) {
@@ -218,7 +256,53 @@ void MainWindow::open_tracelogger() {
 }
 
 void MainWindow::screenshot() {
-    // QApplication::clipboard()->setImage(texture_.toImage());
+    if (!emulator_)
+        return;
+    auto time = QDateTime::currentDateTime().toString("yyyy-MM-dd_hh-mm-ss-zzz").toStdString();
+    emulator_->Screenshot("screenshot_" + time + ".png", TKPEmu::EmulatorFactory::GetSavePath() + "screenshots");
+}
+
+void MainWindow::record_movie() {
+    if (record_act_->isChecked()) {
+        message_queue_->PushRequest({
+            .Id = RequestId::COMMON_START_RECORDING,
+        });
+    } else {
+        std::string path = QFileDialog::getSaveFileName(this, tr("Save movie"), "", "Movie files (*.tkpm)").toStdString();
+        if (path.empty()) {
+            // Keep recording until there's somewhere to save to
+            record_act_->setChecked(true);
+            return;
+        }
+        message_queue_->PushRequest({
+            .Id = RequestId::COMMON_STOP_RECORDING,
+            .Data = path,
+        });
+    }
+}
+
+void MainWindow::record_video() {
+    if (record_video_act_->isChecked()) {
+        auto time = QDateTime::currentDateTime().toString("yyyy-MM-dd_hh-mm-ss").toStdString();
+        message_queue_->PushRequest({
+            .Id = RequestId::COMMON_START_AV_RECORDING,
+            .Data = TKPEmu::EmulatorFactory::GetSavePath() + "recordings/recording_" + time,
+        });
+    } else {
+        message_queue_->PushRequest({
+            .Id = RequestId::COMMON_STOP_AV_RECORDING,
+        });
+    }
+}
+
+void MainWindow::set_upscale_filter(std::optional<TKPEmu::Tools::UpscaleFilter> filter) {
+    if (filter && !upscaler_) {
+        upscale_pool_ = std::make_unique<TKPEmu::Tools::WorkerPool>();
+        upscaler_ = std::make_unique<TKPEmu::Tools::Upscaler>(*upscale_pool_);
+    }
+    upscale_filter_ = filter;
+    // Redraw the current frame with the new filter
+    force_present_ = true;
 }
 
 void MainWindow::close_tools() {
@@ -237,7 +321,12 @@ void MainWindow::enable_emulation_actions(bool should) {
     pause_act_->setEnabled(should);
     stop_act_->setEnabled(should);
     reset_act_->setEnabled(should);
-    lbl_->setVisible(should);
+    record_act_->setEnabled(should);
+    record_act_->setChecked(false);
+    record_video_act_->setEnabled(should);
+    record_video_act_->setChecked(false);
+    screenshot_act_->setEnabled(should);
+    screen_->setVisible(should);
     debugger_act_->setEnabled(false);
     tracelogger_act_->setEnabled(false);
     if (should) {
@@ -248,8 +337,6 @@ void MainWindow::enable_emulation_actions(bool should) {
 }
 
 void MainWindow::setup_emulator_specific() {
-    EmulatorDataMap constant_map;
-    EmulatorUserDataMap user_map;
     QFile f(":/data/emulators.json");
     if (!f.open(QIODevice::ReadOnly)) {
         throw ErrorFactory::generate_exception(__func__, __LINE__, "Could not open default emulators.json");
@@ -277,27 +364,7 @@ void MainWindow::setup_emulator_specific() {
         }
     }
     QString data = f.readAll();
-    json j = json::parse(data.toStdString());
-    json j_mappings = json::parse(data_mappings.toStdString());
-    for (auto it = j.begin(); it != j.end(); ++it) {
-        EmulatorData d;
-        json& o = it.value();
-        o.at("Name").get_to(d.Name);
-        o.at("SettingsFile").get_to(d.SettingsFile);
-        o.at("Extensions").get_to(d.Extensions);
-        o.at("DefaultWidth").get_to(d.DefaultWidth);
-        o.at("DefaultHeight").get_to(d.DefaultHeight);
-        o.at("HasDebugger").get_to(d.HasDebugger);
-        o.at("HasTracelogger").get_to(d.HasTracelogger);
-        o.at("LoggingOptions").get_to(d.LoggingOptions);
-        constant_map[std::stoi(it.key())] = d;
-    }
-    for (auto it = j_mappings.begin(); it != j_mappings.end(); ++it) {
-        auto& d = constant_map[std::stoi(it.key())];
-        json& o = it.value();
-        o.at("KeyNames").get_to(d.Mappings.KeyNames);
-        o.at("KeyValues").get_to(d.Mappings.KeyValues);
-    }
+    EmulatorDataMap constant_map = TKPEmu::EmulatorFactory::ParseEmulatorData(data.toStdString(), data_mappings.toStdString());
     // Write default emulator options if they dont exist
     for (auto& e : constant_map) {
         if (!std::filesystem::exists(TKPEmu::EmulatorFactory::GetSavePath() + e.SettingsFile)) {
@@ -313,35 +380,16 @@ void MainWindow::setup_emulator_specific() {
             }
         }
     }
-    // Read emulator options
-    for (int i = 0; i < static_cast<int>(TKPEmu::EmuType::EmuTypeSize); i++) {
-        std::map<std::string, std::string> temp;
-        const auto& e = constant_map[i];
-        auto path = TKPEmu::EmulatorFactory::GetSavePath() + e.SettingsFile;
-        std::ifstream ifs(path);
-        if (ifs.is_open()) {
-            std::stringstream buf;
-            buf << ifs.rdbuf();
-            json j = json::parse(buf.str());
-            for (auto it = j.begin(); it != j.end(); ++it) {
-                temp[it.key()] = it.value();
-            }
-        } else {
-            throw ErrorFactory::generate_exception(__func__, __LINE__, "Could not open options file");
-        }
-        EmulatorUserData user_data(path, temp);
-        user_map[i] = std::move(user_data);
-    }
+    EmulatorUserDataMap user_map = TKPEmu::EmulatorFactory::LoadEmulatorUserData(constant_map);
     TKPEmu::EmulatorFactory::SetEmulatorData(std::move(constant_map));
     TKPEmu::EmulatorFactory::SetEmulatorUserData(std::move(user_map));
 }
 
 void MainWindow::pause_emulator() {
-    if (emulator_->Paused.load()) {
-        emulator_->Paused.store(false);
-        emulator_->Step.store(true);
-        emulator_->Step.notify_all();
+    if (emulator_->IsPaused()) {
+        emulator_->Resume();
     } else {
+        // Goes through the queue so that listeners get COMMON_PAUSED back
         message_queue_->PushRequest({
             .Id = RequestId::COMMON_PAUSE,
         });
@@ -356,19 +404,84 @@ void MainWindow::reset_emulator() {
 
 void MainWindow::stop_emulator() {
     if (emulator_) {
-        emulator_->CloseAndWait();
+        emulator_runner_.Stop();
         emulator_.reset();
         enable_emulation_actions(false);
     }
 }
 
+void MainWindow::update_present_stats() {
+    // Reallocations should only go up when the resolution changes, anything else means
+    // the presentation path is allocating per frame again
+    QString text = tr("Screen reallocations: %1").arg(screen_->GetReallocations());
+    if (emulator_) {
+        const auto& metrics = emulator_->GetMetrics();
+        text = tr("Presented: %1, unchanged: %2, ").arg(metrics.PresentedFrames.load()).arg(metrics.SkippedFrames.load()) + text;
+    }
+    present_stats_label_->setText(text);
+}
+
+void MainWindow::poll_controllers() {
+    SDL_Event event;
+    while (SDL_PollEvent(&event)) {
+        switch (event.type) {
+            case SDL_CONTROLLERDEVICEADDED: {
+                if (SDL_GameControllerOpen(event.cdevice.which))
+                    open_controllers_++;
+                break;
+            }
+            case SDL_CONTROLLERDEVICEREMOVED: {
+                if (auto* controller = SDL_GameControllerFromInstanceID(event.cdevice.which)) {
+                    SDL_GameControllerClose(controller);
+                    open_controllers_--;
+                }
+                break;
+            }
+            case SDL_CONTROLLERBUTTONDOWN: {
+                if (emulator_)
+                    emulator_->KeyDown(TKPEmu::InputMap::ControllerKey(event.cbutton.button));
+                break;
+            }
+            case SDL_CONTROLLERBUTTONUP: {
+                if (emulator_)
+                    emulator_->KeyUp(TKPEmu::InputMap::ControllerKey(event.cbutton.button));
+                break;
+            }
+        }
+    }
+    int interval = open_controllers_ > 0 ? controller_active_interval : controller_idle_interval;
+    if (controller_timer_->interval() != interval)
+        controller_timer_->setInterval(interval);
+}
+
 void MainWindow::redraw_screen() {
     if (!emulator_)
         return;
-    std::lock_guard<std::mutex> lg(emulator_->DrawMutex);
-    if (!emulator_->IsReadyToDraw())
-        return;
-    QImage image((const unsigned char*)emulator_->GetScreenData(), emulator_->GetWidth(), emulator_->GetHeight(), QImage::Format_RGBA8888);
-    lbl_->setPixmap(QPixmap::fromImage(image.scaled(lbl_->width(), lbl_->height(), Qt::KeepAspectRatio, Qt::FastTransformation)));
-    emulator_->IsReadyToDraw() = false;
+    int width, height;
+    {
+        std::lock_guard<std::mutex> lg(emulator_->DrawMutex);
+        if (!emulator_->IsReadyToDraw())
+            return;
+        if (emulator_->IsResized()) {
+            // Upload reallocates its buffer for the new resolution, make sure it gets this frame
+            force_present_ = true;
+            emulator_->IsResized() = false;
+        }
+        // Unchanged frames are already on screen, resizing the window repaints them from there
+        if (!emulator_->ConsumeFrame(force_present_))
+            return;
+        force_present_ = false;
+        auto* pixels = static_cast<const uint32_t*>(emulator_->GetScreenData());
+        width = emulator_->GetWidth();
+        height = emulator_->GetHeight();
+        if (!upscale_filter_) {
+            screen_->Upload(pixels, width, height);
+            return;
+        }
+        // Upscaling takes a while, the emulator shouldn't wait for it to draw the next frame
+        upscale_source_.assign(pixels, pixels + size_t(width) * height);
+    }
+    int factor = TKPEmu::Tools::GetUpscaleFactor(*upscale_filter_);
+    const uint32_t* upscaled = upscaler_->Process(upscale_source_.data(), width, height, *upscale_filter_);
+    screen_->Upload(upscaled, width * factor, height * factor);
 }
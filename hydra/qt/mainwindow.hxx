@@ -2,15 +2,22 @@
 #ifndef TKP_MAINWINDOW_HXX
 #define TKP_MAINWINDOW_HXX
 #include <QMainWindow>
+#include <QTimer>
 #include <QMenuBar>
 #include <QFileDialog>
 #include <QStatusBar>
 #include <QVBoxLayout>
 #include <QLabel>
+#include <QActionGroup>
 #include <memory>
+#include <optional>
 #include <array>
+#include <vector>
 #include "../include/emulator_factory.h"
 #include "../include/emulator.h"
+#include "../include/emulator_runner.hxx"
+#include "../lib/upscale.hxx"
+#include "screenwidget.hxx"
 
 class MainWindow : public QMainWindow
 {
@@ -30,6 +37,9 @@ private:
     void open_debugger();
     void open_tracelogger();
     void screenshot();
+    void record_movie();
+    void record_video();
+    void set_upscale_filter(std::optional<TKPEmu::Tools::UpscaleFilter> filter);
     void close_tools();
 
     // Emulation functions
@@ -41,6 +51,8 @@ private:
 
 private slots:
     void redraw_screen();
+    void poll_controllers();
+    void update_present_stats();
 
 public:
     MainWindow(QWidget *parent = nullptr);
@@ -56,15 +68,31 @@ public:
     QAction* stop_act_;
     QAction* settings_act_;
     QAction* screenshot_act_;
+    QAction* record_act_;
+    QAction* record_video_act_;
     QAction* debugger_act_;
     QAction* tracelogger_act_;
-    QLabel* lbl_;
-    QPixmap texture_;
+    QActionGroup* filter_group_;
+    ScreenWidget* screen_;
+    // Frame presentation counters, refreshed once a second
+    QLabel* present_stats_label_;
+    // Set when the current frame has to be uploaded again even if it didn't change
+    bool force_present_ = false;
+    // Applied to every frame before Qt scales it to the label, none by default
+    std::optional<TKPEmu::Tools::UpscaleFilter> upscale_filter_;
+    std::unique_ptr<TKPEmu::Tools::WorkerPool> upscale_pool_;
+    std::unique_ptr<TKPEmu::Tools::Upscaler> upscaler_;
+    // Copy of the frame taken under DrawMutex, so the upscaler runs without holding it
+    std::vector<uint32_t> upscale_source_;
     std::shared_ptr<TKPEmu::Tools::MQBase> message_queue_;
     std::shared_ptr<TKPEmu::Emulator> emulator_;
     std::array<QWidget*, 2> emulator_tools_ {};
     TKPEmu::EmuType emulator_type_;
-    std::thread emulator_thread_;
+    TKPEmu::EmulatorRunner emulator_runner_;
+    // Polls SDL every millisecond while a controller is open, and only often enough to
+    // notice one being plugged in otherwise
+    QTimer* controller_timer_;
+    int open_controllers_ = 0;
     bool settings_open_ = false;
     bool about_open_ = false;
     bool debugger_open_ = false;
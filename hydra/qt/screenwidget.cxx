@@ -0,0 +1,32 @@
+#include "screenwidget.hxx"
+#include <QPainter>
+#include <cstring>
+
+ScreenWidget::ScreenWidget(QWidget* parent) : QWidget(parent) {
+    // Every pixel is painted in paintEvent, so Qt doesn't need to clear the background first
+    setAttribute(Qt::WA_OpaquePaintEvent, true);
+    setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Expanding);
+}
+
+void ScreenWidget::Upload(const void* rgba, int width, int height) {
+    if (frame_.width() != width || frame_.height() != height) {
+        frame_ = QImage(width, height, QImage::Format_RGBA8888);
+        reallocations_++;
+    }
+    // Rows of 32-bit pixels are never padded, so the whole frame is one copy. frame_ is
+    // never shared, so bits() doesn't detach
+    std::memcpy(frame_.bits(), rgba, size_t(width) * height * 4);
+    update();
+}
+
+void ScreenWidget::paintEvent(QPaintEvent*) {
+    QPainter painter(this);
+    painter.fillRect(rect(), palette().window());
+    if (frame_.isNull())
+        return;
+    // Largest rectangle with the frame's aspect ratio, centered
+    QSize size = frame_.size().scaled(this->size(), Qt::KeepAspectRatio);
+    QRect target(QPoint((width() - size.width()) / 2, (height() - size.height()) / 2), size);
+    painter.setRenderHint(QPainter::SmoothPixmapTransform, false);
+    painter.drawImage(target, frame_);
+}
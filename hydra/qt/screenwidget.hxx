@@ -0,0 +1,23 @@
+#pragma once
+#ifndef TKP_SCREENWIDGET_H
+#define TKP_SCREENWIDGET_H
+#include <QWidget>
+#include <QImage>
+
+// Presents emulator frames without allocating per frame. The frame is copied into a QImage
+// that is only reallocated when the resolution changes, and painted scaled straight from
+// it, so there is no intermediate scaled image or QPixmap
+class ScreenWidget : public QWidget {
+public:
+    ScreenWidget(QWidget* parent = nullptr);
+    // RGBA8888 pixels, rows top to bottom
+    void Upload(const void* rgba, int width, int height);
+    // Times the frame buffer had to be reallocated, once per resolution change
+    uint64_t GetReallocations() const { return reallocations_; }
+protected:
+    void paintEvent(QPaintEvent* event) override;
+private:
+    QImage frame_;
+    uint64_t reallocations_ = 0;
+};
+#endif
@@ -0,0 +1,156 @@
+#include <include/audio_resampler.hxx>
+#include <include/error_factory.hxx>
+#include <algorithm>
+#include <cmath>
+#if defined(__SSE2__) || defined(_M_X64)
+#define TKP_AUDIO_SSE
+#include <emmintrin.h>
+#endif
+
+namespace {
+    // Both filter dot products for one output frame
+    inline void dot2(const float* left, const float* right, const float* kernel, float& out_left, float& out_right) {
+        #ifdef TKP_AUDIO_SSE
+        __m128 sum_left = _mm_setzero_ps();
+        __m128 sum_right = _mm_setzero_ps();
+        for (int i = 0; i < TKPEmu::AudioResampler::taps; i += 4) {
+            __m128 k = _mm_loadu_ps(kernel + i);
+            sum_left = _mm_add_ps(sum_left, _mm_mul_ps(_mm_loadu_ps(left + i), k));
+            sum_right = _mm_add_ps(sum_right, _mm_mul_ps(_mm_loadu_ps(right + i), k));
+        }
+        // Horizontal sums of both at once
+        __m128 low = _mm_unpacklo_ps(sum_left, sum_right);
+        __m128 high = _mm_unpackhi_ps(sum_left, sum_right);
+        __m128 sum = _mm_add_ps(low, high);
+        sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+        float result[4];
+        _mm_storeu_ps(result, sum);
+        out_left = result[0];
+        out_right = result[1];
+        #else
+        float sum_left = 0, sum_right = 0;
+        for (int i = 0; i < TKPEmu::AudioResampler::taps; i++) {
+            sum_left += left[i] * kernel[i];
+            sum_right += right[i] * kernel[i];
+        }
+        out_left = sum_left;
+        out_right = sum_right;
+        #endif
+    }
+
+    inline int16_t to_int16(float sample) {
+        return std::clamp<int>(std::lrint(sample), INT16_MIN, INT16_MAX);
+    }
+}
+
+namespace TKPEmu {
+    void AudioMixer::Begin(size_t frames) {
+        mix_.assign(frames * 2, 0.0f);
+    }
+
+    void AudioMixer::Add(const int16_t* samples, size_t frames, float gain) {
+        size_t count = std::min(frames * 2, mix_.size());
+        size_t i = 0;
+        #ifdef TKP_AUDIO_SSE
+        __m128 g = _mm_set1_ps(gain);
+        for (; i + 8 <= count; i += 8) {
+            __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + i));
+            // Sign extend to 32 bits by putting each sample in the top half and shifting down
+            __m128 low = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16));
+            __m128 high = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16));
+            _mm_storeu_ps(&mix_[i], _mm_add_ps(_mm_loadu_ps(&mix_[i]), _mm_mul_ps(low, g)));
+            _mm_storeu_ps(&mix_[i + 4], _mm_add_ps(_mm_loadu_ps(&mix_[i + 4]), _mm_mul_ps(high, g)));
+        }
+        #endif
+        for (; i < count; i++)
+            mix_[i] += samples[i] * gain;
+    }
+
+    void AudioMixer::Add(const float* samples, size_t frames, float gain) {
+        size_t count = std::min(frames * 2, mix_.size());
+        size_t i = 0;
+        #ifdef TKP_AUDIO_SSE
+        __m128 g = _mm_set1_ps(gain);
+        for (; i + 4 <= count; i += 4)
+            _mm_storeu_ps(&mix_[i], _mm_add_ps(_mm_loadu_ps(&mix_[i]), _mm_mul_ps(_mm_loadu_ps(samples + i), g)));
+        #endif
+        for (; i < count; i++)
+            mix_[i] += samples[i] * gain;
+    }
+
+    AudioResampler::AudioResampler(double input_rate, double output_rate) {
+        SetRates(input_rate, output_rate);
+        Reset();
+    }
+
+    void AudioResampler::SetRates(double input_rate, double output_rate) {
+        if (input_rate <= 0 || output_rate <= 0)
+            throw ErrorFactory::generate_exception(__func__, __LINE__, "Invalid audio rates");
+        input_rate_ = input_rate;
+        output_rate_ = output_rate;
+        SetRatioAdjust(1.0);
+        constexpr double pi = 3.14159265358979323846;
+        // Relative to the input rate, a little under the Nyquist of whichever rate is lower
+        double cutoff = 0.45 * std::min(1.0, output_rate / input_rate);
+        // One extra row so that phases rounding up to the next sample still have a row
+        kernel_.assign((phase_count + 1) * taps, 0.0f);
+        for (int phase = 0; phase <= phase_count; phase++) {
+            double fraction = double(phase) / phase_count;
+            double sum = 0;
+            double row[taps];
+            for (int i = 0; i < taps; i++) {
+                double t = i - (taps / 2 - 1) - fraction;
+                double x = 2 * pi * cutoff * t;
+                double sinc = t == 0 ? 1 : std::sin(x) / x;
+                double w = (t + taps / 2) / taps;
+                double window = 0.42 - 0.5 * std::cos(2 * pi * w) + 0.08 * std::cos(4 * pi * w);
+                row[i] = sinc * window;
+                sum += row[i];
+            }
+            for (int i = 0; i < taps; i++)
+                kernel_[phase * taps + i] = row[i] / sum;
+        }
+    }
+
+    void AudioResampler::SetRatioAdjust(double adjust) {
+        double step = input_rate_ / (output_rate_ * adjust) * 4294967296.0;
+        // A step that rounds to zero would never advance, and a huge one would overflow
+        if (!(adjust > 0) || !(step >= 0.5) || step > 0x1p62)
+            throw ErrorFactory::generate_exception(__func__, __LINE__, "Invalid resampling ratio");
+        step_ = std::llround(step);
+    }
+
+    void AudioResampler::Process(const float* input, size_t frames, std::vector<int16_t>& out) {
+        size_t old_size = left_.size();
+        left_.resize(old_size + frames);
+        right_.resize(old_size + frames);
+        for (size_t i = 0; i < frames; i++) {
+            left_[old_size + i] = input[i * 2];
+            right_[old_size + i] = input[i * 2 + 1];
+        }
+        size_t available = left_.size();
+        out.reserve(out.size() + (uint64_t(frames) << 32) / step_ * 2 + 2);
+        while ((position_ >> 32) + taps <= available) {
+            size_t index = position_ >> 32;
+            // Rounded to the nearest phase
+            uint32_t phase = ((position_ & 0xFFFFFFFF) + (uint64_t(1) << (31 - phase_bits))) >> (32 - phase_bits);
+            float sample_left, sample_right;
+            dot2(&left_[index], &right_[index], &kernel_[phase * taps], sample_left, sample_right);
+            out.push_back(to_int16(sample_left));
+            out.push_back(to_int16(sample_right));
+            position_ += step_;
+        }
+        // Drop input the filter has moved past
+        size_t consumed = std::min<size_t>(position_ >> 32, available);
+        left_.erase(left_.begin(), left_.begin() + consumed);
+        right_.erase(right_.begin(), right_.begin() + consumed);
+        position_ -= uint64_t(consumed) << 32;
+    }
+
+    void AudioResampler::Reset() {
+        // Half a filter of silence so the first samples are centered on the kernel
+        left_.assign(taps / 2 - 1, 0.0f);
+        right_.assign(taps / 2 - 1, 0.0f);
+        position_ = 0;
+    }
+}
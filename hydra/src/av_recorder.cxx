@@ -0,0 +1,216 @@
+#include <include/av_recorder.hxx>
+#include <include/error_factory.hxx>
+#include <lib/frame_hash.hxx>
+#include <algorithm>
+#include <cstring>
+
+namespace {
+    constexpr uint32_t wav_header_size = 44;
+
+    void put_le(std::ofstream& ofs, uint32_t value, int bytes) {
+        for (int i = 0; i < bytes; i++)
+            ofs.put(static_cast<char>(value >> (i * 8)));
+    }
+
+    void write_wav_header(std::ofstream& ofs, uint32_t sample_rate, uint32_t data_size) {
+        ofs.write("RIFF", 4);
+        put_le(ofs, wav_header_size - 8 + data_size, 4);
+        ofs.write("WAVEfmt ", 8);
+        put_le(ofs, 16, 4);
+        // PCM, stereo, 16 bits per sample
+        put_le(ofs, 1, 2);
+        put_le(ofs, 2, 2);
+        put_le(ofs, sample_rate, 4);
+        put_le(ofs, sample_rate * 4, 4);
+        put_le(ofs, 4, 2);
+        put_le(ofs, 16, 2);
+        ofs.write("data", 4);
+        put_le(ofs, data_size, 4);
+    }
+
+    inline uint8_t clamp_u8(int value) {
+        return std::clamp(value, 0, 255);
+    }
+}
+
+namespace TKPEmu {
+    AVRecorder::AVRecorder(size_t max_queued) : slots_(std::max<size_t>(max_queued, 1)) {
+        writer_ = std::thread(&AVRecorder::writer_loop, this);
+    }
+
+    AVRecorder::~AVRecorder() {
+        if (IsRecording()) {
+            try {
+                Stop();
+            } catch (...) {}
+        }
+        {
+            std::lock_guard<std::mutex> lg(mutex_);
+            stopping_ = true;
+        }
+        slot_filled_.notify_one();
+        writer_.join();
+    }
+
+    void AVRecorder::Start(const std::string& path, uint32_t width, uint32_t height, uint32_t fps, uint32_t sample_rate) {
+        if (IsRecording())
+            throw ErrorFactory::generate_exception(__func__, __LINE__, "Tried to start recording while already recording");
+        video_.open(path + ".y4m", std::ios::binary | std::ios::trunc);
+        audio_.open(path + ".wav", std::ios::binary | std::ios::trunc);
+        if (!video_.is_open() || !audio_.is_open()) {
+            video_.close();
+            audio_.close();
+            throw ErrorFactory::generate_exception(__func__, __LINE__, "Could not create recording at " + path);
+        }
+        width_ = width;
+        height_ = height;
+        audio_bytes_ = 0;
+        sample_rate_ = sample_rate;
+        yuv_.resize(size_t(width) * height * 3);
+        yuv_valid_ = false;
+        // Room for a frame or several frames of audio, so that pushing never has to grow a slot
+        size_t slot_size = std::max<size_t>(size_t(width) * height * 4, size_t(sample_rate) / std::max(fps, 1u) * 4 * 4);
+        for (auto& slot : slots_)
+            slot.Data.reserve(slot_size);
+        video_ << "YUV4MPEG2 W" << width << " H" << height << " F" << fps << ":1 Ip A1:1 C444 XCOLORRANGE=FULL\n";
+        // Sizes are filled in by Stop
+        write_wav_header(audio_, sample_rate, 0);
+        frames_ = 0;
+        audio_frames_ = 0;
+        dropped_ = 0;
+        stalls_ = 0;
+        repeated_ = 0;
+        recording_.store(true);
+    }
+
+    void AVRecorder::Stop() {
+        if (!IsRecording())
+            throw ErrorFactory::generate_exception(__func__, __LINE__, "Tried to stop recording while not recording");
+        recording_.store(false);
+        wait_idle();
+        audio_.seekp(0);
+        write_wav_header(audio_, sample_rate_, audio_bytes_);
+        bool failed = !video_ || !audio_;
+        video_.close();
+        audio_.close();
+        if (failed)
+            throw ErrorFactory::generate_exception(__func__, __LINE__, "Failed to write the recording");
+    }
+
+    void AVRecorder::PushVideo(const uint8_t* rgba, uint32_t width, uint32_t height, std::mutex* source_mutex) {
+        if (!IsRecording())
+            return;
+        if (width != width_ || height != height_) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        Slot& slot = acquire_slot();
+        slot.Video = true;
+        slot.Data.resize(size_t(width) * height * 4);
+        {
+            std::unique_lock<std::mutex> lock;
+            if (source_mutex)
+                lock = std::unique_lock<std::mutex>(*source_mutex);
+            std::memcpy(slot.Data.data(), rgba, slot.Data.size());
+        }
+        submit_slot();
+        frames_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void AVRecorder::PushAudio(const int16_t* samples, size_t frames) {
+        if (!IsRecording() || frames == 0)
+            return;
+        Slot& slot = acquire_slot();
+        slot.Video = false;
+        slot.Data.resize(frames * 4);
+        std::memcpy(slot.Data.data(), samples, slot.Data.size());
+        submit_slot();
+        audio_frames_.fetch_add(frames, std::memory_order_relaxed);
+    }
+
+    AVRecorder::Stats AVRecorder::GetStats() const {
+        return {
+            .Frames = frames_.load(),
+            .AudioFrames = audio_frames_.load(),
+            .Dropped = dropped_.load(),
+            .Repeated = repeated_.load(),
+            .Stalls = stalls_.load(),
+        };
+    }
+
+    AVRecorder::Slot& AVRecorder::acquire_slot() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        // Recordings are lossless, so a full ring makes the emulator wait rather than drop
+        if (queued_ == slots_.size()) {
+            stalls_.fetch_add(1, std::memory_order_relaxed);
+            slot_freed_.wait(lock, [this]() { return queued_ < slots_.size(); });
+        }
+        // The writer only reads queued slots, so this one is ours until submit_slot
+        return slots_[write_index_];
+    }
+
+    void AVRecorder::submit_slot() {
+        {
+            std::lock_guard<std::mutex> lg(mutex_);
+            write_index_ = (write_index_ + 1) % slots_.size();
+            queued_++;
+        }
+        slot_filled_.notify_one();
+    }
+
+    void AVRecorder::wait_idle() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        slot_freed_.wait(lock, [this]() { return queued_ == 0; });
+    }
+
+    void AVRecorder::writer_loop() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            slot_filled_.wait(lock, [this]() { return stopping_ || queued_ != 0; });
+            if (queued_ == 0)
+                return;
+            Slot& slot = slots_[read_index_];
+            lock.unlock();
+            if (slot.Video)
+                write_frame(slot.Data);
+            else
+                write_audio(slot.Data);
+            lock.lock();
+            read_index_ = (read_index_ + 1) % slots_.size();
+            queued_--;
+            slot_freed_.notify_all();
+        }
+    }
+
+    void AVRecorder::write_frame(const std::vector<uint8_t>& rgba) {
+        // Menus and pauses repeat the same frame, which only needs writing out again
+        uint64_t hash = Tools::HashFrame(rgba.data(), rgba.size());
+        if (yuv_valid_ && hash == yuv_hash_) {
+            repeated_.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            yuv_hash_ = hash;
+            yuv_valid_ = true;
+            size_t pixels = size_t(width_) * height_;
+            uint8_t* y = yuv_.data();
+            uint8_t* u = y + pixels;
+            uint8_t* v = u + pixels;
+            // Full range BT.601 in 8 bits of fixed point
+            for (size_t i = 0; i < pixels; i++) {
+                int r = rgba[i * 4];
+                int g = rgba[i * 4 + 1];
+                int b = rgba[i * 4 + 2];
+                y[i] = clamp_u8((77 * r + 150 * g + 29 * b + 128) >> 8);
+                u[i] = clamp_u8(((-43 * r - 85 * g + 128 * b + 128) >> 8) + 128);
+                v[i] = clamp_u8(((128 * r - 107 * g - 21 * b + 128) >> 8) + 128);
+            }
+        }
+        video_.write("FRAME\n", 6);
+        video_.write(reinterpret_cast<const char*>(yuv_.data()), yuv_.size());
+    }
+
+    void AVRecorder::write_audio(const std::vector<uint8_t>& samples) {
+        // WAV is little endian like the hosts we build for, so the samples go out as they are
+        audio_.write(reinterpret_cast<const char*>(samples.data()), samples.size());
+        audio_bytes_ += samples.size();
+    }
+}
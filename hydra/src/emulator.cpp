@@ -1,9 +1,13 @@
-#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <cstring>
 #include <filesystem>
 #include <iostream>
 #include <fstream>
 #include <include/emulator.h>
+#include <include/console_colors.h>
 #include <lib/md5.h>
+#include <lib/png_writer.hxx>
+#include <lib/frame_hash.hxx>
+#include <lib/threadpool.hxx>
 #include <GL/glew.h>
 #include <include/error_factory.hxx>
 #include <lib/str_hash.h>
@@ -13,6 +17,11 @@ namespace {
         std::ifstream in(filename, std::ifstream::ate | std::ifstream::binary);
         return in.tellg(); 
     }
+    // Shared by every emulator, screenshots are encoded and written one at a time here
+    TKPEmu::Tools::BackgroundWorker& screenshot_worker() {
+        static TKPEmu::Tools::BackgroundWorker worker;
+        return worker;
+    }
 }
 
 namespace TKPEmu {
@@ -21,16 +30,151 @@ namespace TKPEmu {
             if (log_file_ptr_->is_open())
                 log_file_ptr_->close();
     }
-    void Emulator::HandleKeyDown(uint32_t keycode) { 
-        std::cout << "Warning: Key " << SDL_GetKeyName(keycode) << " was pressed but\n"
-        	"emulator.HandleKeyDown was not implemented" << std::endl;
+    void Emulator::KeyDown(uint32_t keycode) {
+        host_input(keycode, true);
+    }
+    void Emulator::KeyUp(uint32_t keycode) {
+        host_input(keycode, false);
     }
-    void Emulator::HandleKeyUp(uint32_t keycode) { 
-        std::cout << "Warning: Key " << SDL_GetKeyName(keycode) << " was released but\n"
-        	"emulator.HandleKeyUp was not implemented" << std::endl;
+    void Emulator::host_input(uint32_t keycode, bool down) {
+        if (playing_back_.load())
+            return;
+        // recording_ only changes under this lock, so an input can't slip in between the
+        // check and the queueing while StopRecording flushes the queue
+        std::lock_guard<std::mutex> lg(input_mutex_);
+        if (recording_.load()) {
+            pending_inputs_.push_back({ 0, keycode, down });
+            return;
+        }
+        apply_input(keycode, down);
+    }
+    void Emulator::apply_input(uint32_t keycode, bool down) {
+        if (down) {
+            Input.KeyDown(keycode);
+            HandleKeyDown(keycode);
+        } else {
+            Input.KeyUp(keycode);
+            HandleKeyUp(keycode);
+        }
+    }
+    void Emulator::StartRecording() {
+        if (playing_back_.load())
+            throw ErrorFactory::generate_exception(__func__, __LINE__, "Tried to record while playing back a movie");
+        Reset();
+        std::lock_guard<std::mutex> lg(input_mutex_);
+        pending_inputs_.clear();
+        movie_ = {};
+        movie_start_frame_ = frame_count_;
+        recording_.store(true);
+    }
+    void Emulator::StopRecording(const std::string& path) {
+        if (!recording_.load())
+            throw ErrorFactory::generate_exception(__func__, __LINE__, "Tried to stop recording while not recording");
+        std::lock_guard<std::mutex> lg(input_mutex_);
+        recording_.store(false);
+        // Inputs that didn't make it to a frame boundary are still delivered, just not recorded
+        for (const auto& input : pending_inputs_) {
+            apply_input(input.Key, input.Down);
+        }
+        pending_inputs_.clear();
+        movie_.SetLength(frame_count_ - movie_start_frame_);
+        movie_.Save(path);
+        movie_ = {};
+    }
+    void Emulator::StartPlayback(InputMovie movie) {
+        if (recording_.load())
+            throw ErrorFactory::generate_exception(__func__, __LINE__, "Tried to play back a movie while recording");
+        Reset();
+        movie_ = std::move(movie);
+        movie_index_ = 0;
+        movie_start_frame_ = frame_count_;
+        playing_back_.store(true);
+    }
+    void Emulator::StartAVRecording(const std::string& path, uint32_t fps, uint32_t sample_rate) {
+        if (width_ <= 0 || height_ <= 0)
+            throw ErrorFactory::generate_exception(__func__, __LINE__, "Tried to record without a screen size");
+        std::filesystem::path fs_path(path);
+        if (fs_path.has_parent_path())
+            std::filesystem::create_directories(fs_path.parent_path());
+        if (!av_recorder_)
+            av_recorder_ = std::make_unique<AVRecorder>();
+        av_recorder_->Start(path, width_, height_, fps, sample_rate);
+        av_recording_.store(true);
+    }
+    void Emulator::StopAVRecording() {
+        if (!av_recording_.load())
+            throw ErrorFactory::generate_exception(__func__, __LINE__, "Tried to stop recording video while not recording");
+        av_recording_.store(false);
+        av_recorder_->Stop();
+    }
+    AVRecorder::Stats Emulator::GetAVRecordingStats() const {
+        return av_recorder_ ? av_recorder_->GetStats() : AVRecorder::Stats {};
+    }
+    void Emulator::apply_movie_inputs() {
+        uint64_t frame = frame_count_ - movie_start_frame_;
+        if (recording_.load()) {
+            std::lock_guard<std::mutex> lg(input_mutex_);
+            for (const auto& input : pending_inputs_) {
+                movie_.Record(frame, input.Key, input.Down);
+                apply_input(input.Key, input.Down);
+            }
+            pending_inputs_.clear();
+        } else {
+            const auto& events = movie_.GetEvents();
+            while (movie_index_ < events.size() && events[movie_index_].Frame <= frame) {
+                apply_input(events[movie_index_].Key, events[movie_index_].Down);
+                movie_index_++;
+            }
+            if (movie_index_ == events.size() && frame >= movie_.GetLength())
+                playing_back_.store(false);
+        }
     }
     void Emulator::Screenshot(std::string filename, std::string directory) { 
-		std::lock_guard<std::mutex> lg(DrawMutex);
+        // Only the copy happens under the lock, encoding and disk I/O are left to the worker.
+        // The buffer is sized up front and only resized under the lock if the screen size changed
+        uint32_t width = width_, height = height_;
+        auto pixels = std::make_shared<std::vector<uint8_t>>(size_t(width) * height * 4);
+        {
+            std::lock_guard<std::mutex> lg(DrawMutex);
+            if (width != uint32_t(width_) || height != uint32_t(height_)) [[unlikely]] {
+                width = width_;
+                height = height_;
+                pixels->resize(size_t(width) * height * 4);
+            }
+            std::memcpy(pixels->data(), GetScreenData(), pixels->size());
+        }
+        std::filesystem::path path = directory.empty() ? std::filesystem::path(filename) : std::filesystem::path(directory) / filename;
+        screenshot_worker().Post([path, pixels, width, height]() {
+            try {
+                if (path.has_parent_path())
+                    std::filesystem::create_directories(path.parent_path());
+                Tools::WritePng(path.string(), pixels->data(), width, height);
+            } catch (std::exception& ex) {
+                std::cerr << color_error << ex.what() << color_reset << std::endl;
+            }
+        });
+    }
+    void Emulator::WaitForScreenshots() {
+        screenshot_worker().WaitIdle();
+    }
+    bool Emulator::ConsumeFrame(bool force) {
+        IsReadyToDraw() = false;
+        bool changed;
+        if (dirty_tracking_.load(std::memory_order_relaxed)) {
+            changed = frame_changed_.exchange(false, std::memory_order_relaxed);
+        } else {
+            uint64_t hash = Tools::HashFrame(GetScreenData(), size_t(width_) * height_ * 4);
+            changed = hash != presented_hash_;
+            presented_hash_ = hash;
+        }
+        changed |= !presented_any_;
+        if (changed || force) {
+            presented_any_ = true;
+            metrics_.PresentedFrames.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+        metrics_.SkippedFrames.fetch_add(1, std::memory_order_relaxed);
+        return false;
     }
     void* Emulator::GetScreenData() { 
         throw ErrorFactory::generate_exception(__func__, __LINE__, "GetScreenData was not implemented for this emulator");
@@ -44,6 +188,13 @@ namespace TKPEmu {
 	void Emulator::reset() { 
 		throw ErrorFactory::generate_exception(__func__, __LINE__, "reset was not implemented for this emulator");
     }
+	void Emulator::throw_if_cant_step() const {
+		if (!CanStep())
+			throw ErrorFactory::generate_exception(__func__, __LINE__, "This emulator doesn't implement v_step, so it can't be run synchronously");
+	}
+	void Emulator::v_step() {
+		throw ErrorFactory::generate_exception(__func__, __LINE__, "v_step was not implemented for this emulator");
+	}
 	bool Emulator::load_file(std::string) { 
 		throw ErrorFactory::generate_exception(__func__, __LINE__, "load_file was not implemented for this emulator");
     }
@@ -52,22 +203,79 @@ namespace TKPEmu {
 	}
     void Emulator::Reset() {
         reset();
+        // Whatever the core reallocated on reset shouldn't count against the next frames
+        allocation_monitor_.Reset();
     }
-	void Emulator::CloseAndWait() {
+	uint64_t Emulator::RunFrames(uint64_t frames) {
+		throw_if_cant_step();
+		uint64_t start_cycle = cycle_count_;
+		uint64_t target = frame_count_ + frames;
+		while (frame_count_ < target) {
+			v_step();
+		}
+		return cycle_count_ - start_cycle;
+	}
+	uint64_t Emulator::RunCycles(uint64_t cycles) {
+		throw_if_cant_step();
+		uint64_t start_cycle = cycle_count_;
+		while (cycle_count_ - start_cycle < cycles) {
+			v_step();
+		}
+		return cycle_count_ - start_cycle;
+	}
+	bool Emulator::RunUntil(const std::function<bool()>& predicate, uint64_t max_cycles) {
+		throw_if_cant_step();
+		uint64_t start_cycle = cycle_count_;
+		while (!predicate()) {
+			if (cycle_count_ - start_cycle >= max_cycles)
+				return false;
+			v_step();
+		}
+		return true;
+	}
+	void Emulator::Pause() {
+		Control.Pause();
+		Paused.store(true);
+		Step.store(true);
+		Step.notify_all();
+	}
+	void Emulator::Resume() {
+		Control.Resume();
+		Paused.store(false);
+		Step.store(true);
+		Step.notify_all();
+	}
+	void Emulator::StepInstruction() {
+		Control.StepInstruction();
+		Step.store(true);
+		Step.notify_all();
+	}
+	void Emulator::StepScanline() {
+		Control.StepScanline();
+	}
+	void Emulator::StepFrame() {
+		Control.StepFrame();
+	}
+	void Emulator::RunToCycle(uint64_t cycle) {
+		Control.RunToCycle(cycle);
+	}
+	void Emulator::Close() {
+		Control.Stop();
 		Step.store(true);
         Paused.store(false);
         Stopped.store(true);
 		v_extra_close();
         Step.notify_all();
+	}
+	void Emulator::CloseAndWait() {
+		Close();
 		std::lock_guard<std::mutex> lguard(ThreadStartedMutex);
 	}
     bool Emulator::poll_request(const Request& request) {
         auto cur = request.Id;
         switch (cur) {
             case RequestId::COMMON_PAUSE: {
-                Paused.store(true);
-                Step.store(true);
-                Step.notify_all();
+                Pause();
                 Response response {
                     .Id = ResponseId::COMMON_PAUSED,
                 };
@@ -99,6 +307,22 @@ namespace TKPEmu {
                 logging_ = false;
                 return true;
             }
+            case RequestId::COMMON_START_RECORDING: {
+                StartRecording();
+                return true;
+            }
+            case RequestId::COMMON_STOP_RECORDING: {
+                StopRecording(std::any_cast<std::string>(request.Data));
+                return true;
+            }
+            case RequestId::COMMON_START_AV_RECORDING: {
+                StartAVRecording(std::any_cast<std::string>(request.Data));
+                return true;
+            }
+            case RequestId::COMMON_STOP_AV_RECORDING: {
+                StopAVRecording();
+                return true;
+            }
             default: return poll_uncommon_request(request);
         }
         return false;
@@ -1,4 +1,6 @@
 #include <iostream>
+#include <fstream>
+#include <sstream>
 #include <lib/str_hash.h>
 #include <include/emulator_factory.h>
 #include <include/error_factory.hxx>
@@ -40,23 +42,85 @@ namespace TKPEmu {
         }
     }
     std::shared_ptr<Emulator> EmulatorFactory::Create(EmuType type) { 
+        std::shared_ptr<Emulator> emulator;
         switch (type) {
             case EmuType::Gameboy: {
-                return std::make_shared<Gameboy::Gameboy_TKPWrapper>();
+                emulator = std::make_shared<Gameboy::Gameboy_TKPWrapper>();
+                break;
             }
             case EmuType::N64: {
-                return std::make_shared<N64::N64_TKPWrapper>();
+                emulator = std::make_shared<N64::N64_TKPWrapper>();
+                break;
             }
             case EmuType::Chip8: {
-                return std::make_shared<Chip8::Chip8>();
+                emulator = std::make_shared<Chip8::Chip8>();
+                break;
             }
             case EmuType::NES: {
-                return std::make_shared<NES::NES_TKPWrapper>();
+                emulator = std::make_shared<NES::NES_TKPWrapper>();
+                break;
             }
             default: {
                 throw ErrorFactory::generate_exception(__func__, __LINE__, "EmulatorFactory::Create failed");
             }
         }
+        const auto& data = emulator_data_.at(static_cast<int>(type));
+        emulator->SetWidth(data.DefaultWidth);
+        emulator->SetHeight(data.DefaultHeight);
+        emulator->Input.Load(data.Mappings);
+        return emulator;
+    }
+    KeyMappings EmulatorFactory::GetMappings(EmuType type) {
+        return emulator_data_.at(static_cast<int>(type)).Mappings;
+    }
+    EmulatorDataMap EmulatorFactory::ParseEmulatorData(const std::string& emulators_json, const std::string& mappings_json) {
+        EmulatorDataMap constant_map;
+        json j = json::parse(emulators_json);
+        json j_mappings = json::parse(mappings_json);
+        for (auto it = j.begin(); it != j.end(); ++it) {
+            EmulatorData d;
+            json& o = it.value();
+            o.at("Name").get_to(d.Name);
+            o.at("SettingsFile").get_to(d.SettingsFile);
+            o.at("Extensions").get_to(d.Extensions);
+            o.at("DefaultWidth").get_to(d.DefaultWidth);
+            o.at("DefaultHeight").get_to(d.DefaultHeight);
+            o.at("HasDebugger").get_to(d.HasDebugger);
+            o.at("HasTracelogger").get_to(d.HasTracelogger);
+            o.at("LoggingOptions").get_to(d.LoggingOptions);
+            constant_map[std::stoi(it.key())] = d;
+        }
+        for (auto it = j_mappings.begin(); it != j_mappings.end(); ++it) {
+            auto& d = constant_map[std::stoi(it.key())];
+            json& o = it.value();
+            o.at("KeyNames").get_to(d.Mappings.KeyNames);
+            o.at("KeyValues").get_to(d.Mappings.KeyValues);
+            if (o.contains("ControllerValues"))
+                o.at("ControllerValues").get_to(d.Mappings.ControllerValues);
+        }
+        return constant_map;
+    }
+    EmulatorUserDataMap EmulatorFactory::LoadEmulatorUserData(const EmulatorDataMap& data) {
+        EmulatorUserDataMap user_map;
+        for (int i = 0; i < static_cast<int>(EmuType::EmuTypeSize); i++) {
+            std::map<std::string, std::string> temp;
+            const auto& e = data[i];
+            auto path = GetSavePath() + e.SettingsFile;
+            std::ifstream ifs(path);
+            if (ifs.is_open()) {
+                std::stringstream buf;
+                buf << ifs.rdbuf();
+                json j = json::parse(buf.str());
+                for (auto it = j.begin(); it != j.end(); ++it) {
+                    temp[it.key()] = it.value();
+                }
+            } else {
+                throw ErrorFactory::generate_exception(__func__, __LINE__, "Could not open options file");
+            }
+            EmulatorUserData user_data(path, temp);
+            user_map[i] = std::move(user_data);
+        }
+        return user_map;
     }
     void EmulatorFactory::SetEmulatorData(EmulatorDataMap map) {
         EmulatorFactory::emulator_data_ = std::move(map);
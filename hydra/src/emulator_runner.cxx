@@ -0,0 +1,55 @@
+#include <iostream>
+#include <include/emulator_runner.hxx>
+#include <include/console_colors.h>
+
+namespace TKPEmu {
+    EmulatorRunner::~EmulatorRunner() {
+        Stop();
+    }
+
+    void EmulatorRunner::Start(std::shared_ptr<Emulator> emulator) {
+        Stop();
+        emulator_ = std::move(emulator);
+        running_ = std::make_shared<std::atomic_bool>(true);
+        std::promise<void> exited;
+        exited_ = exited.get_future();
+        // The thread keeps its own reference so the emulator outlives it no matter
+        // what the owner of the runner does with theirs
+        thread_ = std::thread([emulator = emulator_, running = running_, exited = std::move(exited)]() mutable {
+            try {
+                emulator->Start();
+            } catch (std::exception& ex) {
+                std::cerr << color_error << ex.what() << color_reset << std::endl;
+            }
+            running->store(false);
+            exited.set_value();
+        });
+    }
+
+    bool EmulatorRunner::Stop(std::chrono::milliseconds timeout) {
+        if (!thread_.joinable()) {
+            emulator_.reset();
+            return true;
+        }
+        auto start = std::chrono::steady_clock::now();
+        emulator_->Close();
+        if (exited_.wait_for(timeout) != std::future_status::ready) {
+            std::cerr << color_error << "Emulator thread didn't stop within " << timeout.count()
+                << "ms, leaving it behind" << color_reset << std::endl;
+            thread_.detach();
+            emulator_.reset();
+            return false;
+        }
+        Join();
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+        if (elapsed > timeout / 4)
+            std::cerr << "Emulator thread took " << elapsed.count() << "ms to stop" << std::endl;
+        return true;
+    }
+
+    void EmulatorRunner::Join() {
+        if (thread_.joinable())
+            thread_.join();
+        emulator_.reset();
+    }
+}
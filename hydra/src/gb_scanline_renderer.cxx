@@ -0,0 +1,88 @@
+#include <include/gb_scanline_renderer.hxx>
+#include <algorithm>
+
+namespace TKPEmu::Gameboy {
+    void ScanlineRenderer::decode_map_row(const uint8_t* vram, uint16_t map_offset, int first_column, int tile_count, int fine_y, bool unsigned_tiles) {
+        for (int i = 0; i < tile_count; i++) {
+            uint8_t tile = vram[map_offset + ((first_column + i) & 31)];
+            uint16_t address = unsigned_tiles ? tile * 16 : 0x1000 + int8_t(tile) * 16;
+            address += fine_y * 2;
+            rows_[i * 2] = vram[address];
+            rows_[i * 2 + 1] = vram[address + 1];
+        }
+        ops_.DecodeRows(rows_.data(), tile_count, pixels_.data());
+    }
+
+    bool ScanlineRenderer::RenderLine(const uint8_t* vram, const OamEntry* oam, const ScanlineRegisters& regs, uint8_t* out) {
+        // On DMG, LCDC bit 0 blanks both the background and the window
+        bool bg_enabled = regs.LCDC & 0x01;
+        bool unsigned_tiles = regs.LCDC & 0x10;
+        bool window_drawn = false;
+        if (bg_enabled) {
+            uint8_t y = regs.LY + regs.SCY;
+            uint16_t map_offset = ((regs.LCDC & 0x08) ? 0x1C00 : 0x1800) + (y / 8) * 32;
+            decode_map_row(vram, map_offset, regs.SCX / 8, 21, y % 8, unsigned_tiles);
+            std::copy_n(pixels_.begin() + (regs.SCX & 7), width, bg_.begin());
+            if ((regs.LCDC & 0x20) && regs.LY >= regs.WY && regs.WX <= 166) {
+                int start = regs.WX - 7;
+                // With WX below 7 the window starts partly off screen
+                int skip = start < 0 ? -start : 0;
+                start = std::max(start, 0);
+                int tile_count = (skip + width - start + 7) / 8;
+                uint16_t map_offset = ((regs.LCDC & 0x40) ? 0x1C00 : 0x1800) + (regs.WindowLine / 8) * 32;
+                decode_map_row(vram, map_offset, 0, tile_count, regs.WindowLine % 8, unsigned_tiles);
+                std::copy_n(pixels_.begin() + skip, width - start, bg_.begin() + start);
+                window_drawn = true;
+            }
+        } else {
+            bg_.fill(0);
+        }
+        obj_color_.fill(0);
+        if (regs.LCDC & 0x02) {
+            int height = (regs.LCDC & 0x04) ? 16 : 8;
+            // The first 10 sprites in OAM order on this line, offscreen ones included
+            std::array<OamEntry, 10> selected;
+            int count = 0;
+            for (int i = 0; i < 40 && count < 10; i++) {
+                int row = regs.LY - (oam[i].Y - 16);
+                if (row >= 0 && row < height)
+                    selected[count++] = oam[i];
+            }
+            // Lower X wins, ties go to the earlier OAM entry
+            std::stable_sort(selected.begin(), selected.begin() + count, [](const OamEntry& a, const OamEntry& b) {
+                return a.X < b.X;
+            });
+            uint8_t sprite_pixels[8];
+            for (int i = 0; i < count; i++) {
+                const OamEntry& sprite = selected[i];
+                int row = regs.LY - (sprite.Y - 16);
+                if (sprite.Flags & 0x40)
+                    row = height - 1 - row;
+                uint8_t tile = height == 16 ? sprite.Tile & 0xFE : sprite.Tile;
+                const uint8_t* data = vram + tile * 16 + row * 2;
+                if (sprite.Flags & 0x20)
+                    ops_.DecodeRowsFlipped(data, 1, sprite_pixels);
+                else
+                    ops_.DecodeRows(data, 1, sprite_pixels);
+                for (int px = 0; px < 8; px++) {
+                    int x = sprite.X - 8 + px;
+                    // A higher priority sprite keeps the pixel even if it then loses to the background
+                    if (x < 0 || x >= width || obj_color_[x] || !sprite_pixels[px])
+                        continue;
+                    obj_color_[x] = sprite_pixels[px];
+                    obj_flags_[x] = sprite.Flags;
+                }
+            }
+        }
+        for (int x = 0; x < width; x++) {
+            uint8_t color = obj_color_[x];
+            if (color && !((obj_flags_[x] & 0x80) && bg_[x])) {
+                uint8_t palette = (obj_flags_[x] & 0x10) ? regs.OBP1 : regs.OBP0;
+                out[x] = (palette >> (color * 2)) & 3;
+            } else {
+                out[x] = bg_enabled ? (regs.BGP >> (bg_[x] * 2)) & 3 : 0;
+            }
+        }
+        return window_drawn;
+    }
+}
@@ -0,0 +1,20 @@
+#include <include/input_map.hxx>
+#include <include/error_factory.hxx>
+
+namespace TKPEmu {
+    void InputMap::Load(const KeyMappings& mappings) {
+        if (mappings.KeyNames.size() > 32)
+            throw ErrorFactory::generate_exception(__func__, __LINE__, "An emulator can't have more than 32 buttons");
+        table_.fill(0);
+        for (size_t i = 0; i < mappings.KeyValues.size() && i < mappings.KeyNames.size(); i++) {
+            table_[get_index(mappings.KeyValues[i])] |= 1u << i;
+        }
+        for (size_t i = 0; i < mappings.ControllerValues.size() && i < mappings.KeyNames.size(); i++) {
+            table_[get_index(ControllerKey(mappings.ControllerValues[i]))] |= 1u << i;
+        }
+        table_[unmapped_index] = 0;
+        held_keys_.fill(false);
+        hold_counts_.fill(0);
+        state_.store(0);
+    }
+}
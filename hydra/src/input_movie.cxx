@@ -0,0 +1,81 @@
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <include/input_movie.hxx>
+#include <include/error_factory.hxx>
+
+namespace {
+    constexpr char movie_magic[4] = { 'T', 'K', 'P', 'M' };
+    constexpr uint8_t movie_version = 1;
+
+    void write_varint(std::vector<uint8_t>& out, uint64_t value) {
+        while (value >= 0x80) {
+            out.push_back(static_cast<uint8_t>(value) | 0x80);
+            value >>= 7;
+        }
+        out.push_back(static_cast<uint8_t>(value));
+    }
+
+    uint64_t read_varint(const std::vector<uint8_t>& in, size_t& pos) {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (pos >= in.size())
+                throw ErrorFactory::generate_exception(__func__, __LINE__, "Movie file is truncated");
+            uint8_t byte = in[pos++];
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if (!(byte & 0x80))
+                return value;
+        }
+        throw ErrorFactory::generate_exception(__func__, __LINE__, "Movie file is corrupted");
+    }
+}
+
+namespace TKPEmu {
+    void InputMovie::Record(uint64_t frame, uint32_t key, bool down) {
+        events_.push_back({ frame, key, down });
+        length_ = std::max(length_, frame);
+    }
+
+    void InputMovie::Save(const std::string& path) const {
+        std::vector<uint8_t> data(std::begin(movie_magic), std::end(movie_magic));
+        data.push_back(movie_version);
+        write_varint(data, length_);
+        write_varint(data, events_.size());
+        uint64_t last_frame = 0;
+        for (const auto& event : events_) {
+            write_varint(data, event.Frame - last_frame);
+            write_varint(data, (static_cast<uint64_t>(event.Key) << 1) | event.Down);
+            last_frame = event.Frame;
+        }
+        std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+        if (!ofs.is_open())
+            throw ErrorFactory::generate_exception(__func__, __LINE__, "Could not open movie file for writing");
+        ofs.write(reinterpret_cast<const char*>(data.data()), data.size());
+    }
+
+    InputMovie InputMovie::Load(const std::string& path) {
+        std::ifstream ifs(path, std::ios::binary);
+        if (!ifs.is_open())
+            throw ErrorFactory::generate_exception(__func__, __LINE__, "Could not open movie file");
+        std::vector<uint8_t> data((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+        if (data.size() < sizeof(movie_magic) + 1 || !std::equal(std::begin(movie_magic), std::end(movie_magic), data.begin()))
+            throw ErrorFactory::generate_exception(__func__, __LINE__, "Not a movie file");
+        if (data[sizeof(movie_magic)] != movie_version)
+            throw ErrorFactory::generate_exception(__func__, __LINE__, "Unsupported movie version");
+        size_t pos = sizeof(movie_magic) + 1;
+        InputMovie movie;
+        movie.length_ = read_varint(data, pos);
+        uint64_t count = read_varint(data, pos);
+        // Every event takes at least two bytes, a larger count means the file was cut short
+        if (count > (data.size() - pos) / 2)
+            throw ErrorFactory::generate_exception(__func__, __LINE__, "Movie file is truncated");
+        movie.events_.reserve(count);
+        uint64_t frame = 0;
+        for (uint64_t i = 0; i < count; i++) {
+            frame += read_varint(data, pos);
+            uint64_t key_down = read_varint(data, pos);
+            movie.events_.push_back({ frame, static_cast<uint32_t>(key_down >> 1), static_cast<bool>(key_down & 1) });
+        }
+        return movie;
+    }
+}
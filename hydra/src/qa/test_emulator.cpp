@@ -0,0 +1,634 @@
+#include <cppunit/extensions/HelperMacros.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <filesystem>
+#include <lib/emulator_control.hxx>
+#include <include/emulator.h>
+#include <include/emulator_runner.hxx>
+#include <include/scheduler.hxx>
+#include <include/catch_up.hxx>
+#include <include/idle_loop_detector.hxx>
+#include <include/audio_resampler.hxx>
+#include <include/av_recorder.hxx>
+#include <lib/alloc_tracker.hxx>
+#include <fstream>
+#include <iterator>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <zlib.h>
+
+namespace TKPEmu::QA {
+    // Decodes an 8-bit RGBA non-interlaced PNG, checking the signature and every chunk's CRC
+    // on the way. Returns false if any of that is wrong
+    bool decode_png(const std::vector<uint8_t>& png, uint32_t& width, uint32_t& height, std::vector<uint8_t>& rgba) {
+        static const uint8_t signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+        if (png.size() < 8 || std::memcmp(png.data(), signature, 8) != 0)
+            return false;
+        auto be32 = [&](size_t pos) {
+            return uint32_t(png[pos] << 24) | (png[pos + 1] << 16) | (png[pos + 2] << 8) | png[pos + 3];
+        };
+        std::vector<uint8_t> idat;
+        bool header = false, end = false;
+        size_t pos = 8;
+        while (!end) {
+            if (pos + 12 > png.size())
+                return false;
+            uint32_t length = be32(pos);
+            if (length > png.size() - pos - 12)
+                return false;
+            const uint8_t* type = &png[pos + 4];
+            const uint8_t* data = &png[pos + 8];
+            if (crc32(0, type, length + 4) != be32(pos + 8 + length))
+                return false;
+            if (std::memcmp(type, "IHDR", 4) == 0) {
+                if (length != 13)
+                    return false;
+                width = be32(pos + 8);
+                height = be32(pos + 12);
+                // 8 bits, RGBA, deflate, filtering method 0, no interlacing
+                if (data[8] != 8 || data[9] != 6 || data[10] != 0 || data[11] != 0 || data[12] != 0)
+                    return false;
+                header = true;
+            } else if (std::memcmp(type, "IDAT", 4) == 0) {
+                idat.insert(idat.end(), data, data + length);
+            } else if (std::memcmp(type, "IEND", 4) == 0) {
+                end = true;
+            }
+            pos += 12 + length;
+        }
+        if (!header || pos != png.size())
+            return false;
+        size_t stride = size_t(width) * 4;
+        std::vector<uint8_t> raw((stride + 1) * height);
+        uLongf raw_size = raw.size();
+        if (uncompress(raw.data(), &raw_size, idat.data(), idat.size()) != Z_OK || raw_size != raw.size())
+            return false;
+        rgba.assign(stride * height, 0);
+        for (uint32_t y = 0; y < height; y++) {
+            uint8_t filter = raw[y * (stride + 1)];
+            const uint8_t* in = &raw[y * (stride + 1) + 1];
+            uint8_t* out = &rgba[y * stride];
+            const uint8_t* up = y ? out - stride : nullptr;
+            for (size_t x = 0; x < stride; x++) {
+                int a = x >= 4 ? out[x - 4] : 0;
+                int b = up ? up[x] : 0;
+                int c = up && x >= 4 ? up[x - 4] : 0;
+                int predicted = 0;
+                switch (filter) {
+                    case 0: predicted = 0; break;
+                    case 1: predicted = a; break;
+                    case 2: predicted = b; break;
+                    case 3: predicted = (a + b) / 2; break;
+                    case 4: {
+                        int p = a + b - c;
+                        int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+                        predicted = (pa <= pb && pa <= pc) ? a : (pb <= pc ? b : c);
+                        break;
+                    }
+                    default: return false;
+                }
+                out[x] = in[x] + predicted;
+            }
+        }
+        return true;
+    }
+
+    using Control = TKPEmu::Tools::EmulatorControl;
+    // Minimal core where every instruction takes 4 cycles and a frame is 100 instructions
+    class FakeEmulator : public TKPEmu::Emulator {
+    public:
+        int Instructions = 0;
+        std::vector<uint8_t> Screen = std::vector<uint8_t>(16 * 8 * 4);
+        void* GetScreenData() override { return Screen.data(); }
+        // Handed to push_audio at the end of every frame
+        std::vector<int16_t> Audio;
+        // Frame and key of every input the core received, negative keys are releases
+        std::vector<std::pair<uint64_t, int64_t>> Inputs;
+        void HandleKeyDown(uint32_t key) override { Inputs.push_back({ frame_count_, key }); }
+        void HandleKeyUp(uint32_t key) override { Inputs.push_back({ frame_count_, -int64_t(key) }); }
+        bool CanStep() const override { return true; }
+    private:
+        void reset() override {}
+        void v_step() override {
+            Instructions++;
+            on_instruction(4);
+            if (Instructions % 100 == 0) {
+                push_audio(Audio.data(), Audio.size() / 2);
+                on_frame();
+            }
+        }
+        bool poll_uncommon_request(const Request&) override { return false; }
+    };
+    // Writes the value of its palette register to one pixel per cycle
+    struct FakePpu {
+        std::vector<uint8_t> Pixels = std::vector<uint8_t>(4096);
+        uint8_t Palette = 0;
+        void RunCycles(uint64_t from, uint64_t to) {
+            for (uint64_t cycle = from; cycle < to; cycle++)
+                Pixels[cycle % Pixels.size()] = Palette;
+        }
+    };
+    // Waits for vblank in a two instruction loop, `ld a, (vblank); jr z, loop`,
+    // with vblank set by a scheduled event
+    class IdleEmulator : public TKPEmu::Emulator {
+    public:
+        bool SkipIdle = false;
+        bool VBlank = false;
+        int Instructions = 0;
+        IdleEmulator() {
+            auto vblank = scheduler_.Register([this](uint64_t) { VBlank = true; });
+            scheduler_.Schedule(vblank, 70224);
+        }
+        bool CanStep() const override { return true; }
+    private:
+        void reset() override {}
+        void v_step() override {
+            Instructions++;
+            if (pc_ == 0) {
+                a_ = VBlank;
+                detector_.OnInstruction(4);
+                pc_ = 1;
+            } else if (a_ == 0) {
+                detector_.OnInstruction(4);
+                pc_ = 0;
+                if (detector_.OnBranch(0, a_) && SkipIdle)
+                    skip_idle(scheduler_, detector_.GetLoopCycles());
+            } else {
+                on_frame();
+            }
+            scheduler_.AddCycles(4);
+            on_instruction(4);
+            scheduler_.RunEvents();
+        }
+        bool poll_uncommon_request(const Request&) override { return false; }
+        TKPEmu::Scheduler scheduler_;
+        TKPEmu::IdleLoopDetector detector_;
+        int pc_ = 0;
+        uint8_t a_ = 0;
+    };
+    // Core that doesn't implement v_step, like every real core so far
+    class NoStepEmulator : public TKPEmu::Emulator {
+    private:
+        void reset() override {}
+        bool poll_uncommon_request(const Request&) override { return false; }
+    };
+    // Runs on its own thread and sleeps on Step between instructions like the threaded cores
+    class LoopingEmulator : public TKPEmu::Emulator {
+    public:
+        std::atomic_bool Started = false;
+        // While set the core doesn't return after Close, like one stuck in a blocking call
+        std::atomic_bool Stuck = false;
+    private:
+        void start() override {
+            Started.store(true);
+            while (!Stopped.load()) {
+                Step.wait(false);
+                Step.store(false);
+            }
+            while (Stuck.load())
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        void reset() override {}
+        bool poll_uncommon_request(const Request&) override { return false; }
+    };
+    class TestEmulator : public CppUnit::TestFixture {
+        void testControlStepping();
+        void testControlRunToCycle();
+        void testControlWait();
+        void testRunFrames();
+        void testRunCycles();
+        void testRunUntil();
+        void testMovieReplay();
+        void testInputMap();
+        void testScheduler();
+        void testCatchUp();
+        void testIdleSkip();
+        void testAudioResampler();
+        void testScreenshot();
+        void testAVRecording();
+        void testFrameDedup();
+        void testSteadyStateAllocations();
+        void testEmulatorRunner();
+        CPPUNIT_TEST_SUITE(TestEmulator);
+        CPPUNIT_TEST(testControlStepping);
+        CPPUNIT_TEST(testControlRunToCycle);
+        CPPUNIT_TEST(testControlWait);
+        CPPUNIT_TEST(testRunFrames);
+        CPPUNIT_TEST(testRunCycles);
+        CPPUNIT_TEST(testRunUntil);
+        CPPUNIT_TEST(testMovieReplay);
+        CPPUNIT_TEST(testInputMap);
+        CPPUNIT_TEST(testScheduler);
+        CPPUNIT_TEST(testCatchUp);
+        CPPUNIT_TEST(testIdleSkip);
+        CPPUNIT_TEST(testAudioResampler);
+        CPPUNIT_TEST(testScreenshot);
+        CPPUNIT_TEST(testAVRecording);
+        CPPUNIT_TEST(testFrameDedup);
+        CPPUNIT_TEST(testSteadyStateAllocations);
+        CPPUNIT_TEST(testEmulatorRunner);
+        CPPUNIT_TEST_SUITE_END();
+    };
+    void TestEmulator::testControlStepping() {
+        Control control;
+        control.Pause();
+        CPPUNIT_ASSERT(control.IsPaused());
+        control.StepFrame();
+        CPPUNIT_ASSERT(!control.IsPaused());
+        control.OnInstruction(4);
+        control.OnScanline();
+        CPPUNIT_ASSERT(!control.IsPaused());
+        control.OnFrame();
+        CPPUNIT_ASSERT(control.IsPaused());
+        control.StepInstruction();
+        control.OnInstruction(8);
+        CPPUNIT_ASSERT(control.IsPaused());
+        control.StepScanline();
+        control.OnFrame();
+        CPPUNIT_ASSERT(!control.IsPaused());
+        control.OnScanline();
+        CPPUNIT_ASSERT(control.IsPaused());
+    }
+    void TestEmulator::testControlRunToCycle() {
+        Control control;
+        control.RunToCycle(100);
+        control.OnInstruction(96);
+        CPPUNIT_ASSERT(!control.IsPaused());
+        control.OnInstruction(100);
+        CPPUNIT_ASSERT(control.IsPaused());
+    }
+    void TestEmulator::testControlWait() {
+        Control control;
+        CPPUNIT_ASSERT(control.Wait());
+        control.Pause();
+        std::thread resumer([&control]() {
+            control.Resume();
+        });
+        CPPUNIT_ASSERT(control.Wait());
+        resumer.join();
+        control.Pause();
+        std::thread stopper([&control]() {
+            control.Stop();
+        });
+        CPPUNIT_ASSERT(!control.Wait());
+        stopper.join();
+        // Stopped is final
+        control.Resume();
+        CPPUNIT_ASSERT(control.IsStopped());
+    }
+    void TestEmulator::testRunFrames() {
+        FakeEmulator emulator;
+        CPPUNIT_ASSERT_EQUAL(uint64_t(800), emulator.RunFrames(2));
+        CPPUNIT_ASSERT_EQUAL(uint64_t(2), emulator.GetFrameCount());
+        CPPUNIT_ASSERT_EQUAL(200, emulator.Instructions);
+        // Cores without v_step are rejected up front instead of throwing from inside the loop
+        NoStepEmulator no_step;
+        CPPUNIT_ASSERT(!no_step.CanStep());
+        CPPUNIT_ASSERT_THROW(no_step.RunFrames(1), std::runtime_error);
+    }
+    void TestEmulator::testRunCycles() {
+        FakeEmulator emulator;
+        // Overshoots by at most one instruction
+        CPPUNIT_ASSERT_EQUAL(uint64_t(12), emulator.RunCycles(10));
+        CPPUNIT_ASSERT_EQUAL(uint64_t(12), emulator.GetCycleCount());
+        CPPUNIT_ASSERT_EQUAL(uint64_t(400), emulator.RunCycles(400));
+    }
+    void TestEmulator::testRunUntil() {
+        FakeEmulator emulator;
+        CPPUNIT_ASSERT(emulator.RunUntil([&emulator]() { return emulator.Instructions == 42; }));
+        CPPUNIT_ASSERT_EQUAL(42, emulator.Instructions);
+        CPPUNIT_ASSERT(!emulator.RunUntil([]() { return false; }, 40));
+        CPPUNIT_ASSERT_EQUAL(52, emulator.Instructions);
+    }
+    void TestEmulator::testMovieReplay() {
+        auto path = (std::filesystem::temp_directory_path() / "tkp_test_movie.tkpm").string();
+        FakeEmulator recorder;
+        recorder.RunFrames(3);
+        recorder.StartRecording();
+        recorder.RunCycles(10);
+        // Deferred until the next frame boundary
+        recorder.KeyDown(90);
+        CPPUNIT_ASSERT(recorder.Inputs.empty());
+        recorder.RunFrames(2);
+        recorder.KeyUp(90);
+        recorder.KeyDown(1 << 24);
+        recorder.RunFrames(300);
+        recorder.StopRecording(path);
+        CPPUNIT_ASSERT_EQUAL(size_t(3), recorder.Inputs.size());
+        auto movie = TKPEmu::InputMovie::Load(path);
+        CPPUNIT_ASSERT_EQUAL(uint64_t(302), movie.GetLength());
+        FakeEmulator player;
+        player.RunFrames(1);
+        player.StartPlayback(std::move(movie));
+        player.KeyDown(5);
+        player.RunFrames(302);
+        CPPUNIT_ASSERT(!player.IsPlayingBack());
+        CPPUNIT_ASSERT_EQUAL(recorder.Inputs.size(), player.Inputs.size());
+        for (size_t i = 0; i < player.Inputs.size(); i++) {
+            // Same frame relative to where the recording started
+            CPPUNIT_ASSERT_EQUAL(recorder.Inputs[i].first - 3, player.Inputs[i].first - 1);
+            CPPUNIT_ASSERT_EQUAL(recorder.Inputs[i].second, player.Inputs[i].second);
+        }
+        // A header claiming far more events than the file holds is rejected
+        {
+            std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+            const uint8_t truncated[] = { 'T', 'K', 'P', 'M', 1, 10, 0xFF, 0xFF, 0xFF, 0x7F, 1, 2 };
+            ofs.write(reinterpret_cast<const char*>(truncated), sizeof(truncated));
+        }
+        CPPUNIT_ASSERT_THROW(TKPEmu::InputMovie::Load(path), std::runtime_error);
+        std::filesystem::remove(path);
+    }
+    void TestEmulator::testInputMap() {
+        KeyMappings mappings {
+            .KeyNames = { "Right", "A", "Start" },
+            .KeyValues = { 0x01000014, 'Z', 0x01000004 },
+            .ControllerValues = { 14, 1, 6 },
+        };
+        TKPEmu::InputMap map;
+        map.Load(mappings);
+        map.KeyDown('Z');
+        map.KeyDown(0x01000014);
+        CPPUNIT_ASSERT_EQUAL(0b011u, map.GetButtons());
+        map.KeyUp('Z');
+        map.KeyDown(TKPEmu::InputMap::ControllerKey(6));
+        CPPUNIT_ASSERT_EQUAL(0b101u, map.GetButtons());
+        // Keys outside the table and unmapped keys don't change anything
+        map.KeyDown('X');
+        map.KeyDown(0x0100FFFF);
+        map.KeyDown(0xFFFFFFFF);
+        CPPUNIT_ASSERT_EQUAL(0b101u, map.GetButtons());
+        // Start is held by both the keyboard and the pad, it's released with the last of them
+        map.KeyDown(0x01000004);
+        map.KeyUp(TKPEmu::InputMap::ControllerKey(6));
+        CPPUNIT_ASSERT_EQUAL(0b101u, map.GetButtons());
+        // Repeated presses of a held key don't need as many releases
+        map.KeyDown(0x01000004);
+        map.KeyUp(0x01000004);
+        CPPUNIT_ASSERT_EQUAL(0b001u, map.GetButtons());
+        map.KeyUp(0x01000014);
+        map.KeyUp(0x01000014);
+        CPPUNIT_ASSERT_EQUAL(0u, map.GetButtons());
+    }
+    void TestEmulator::testScheduler() {
+        TKPEmu::Scheduler scheduler;
+        std::vector<std::pair<char, uint64_t>> fired;
+        TKPEmu::Scheduler::EventId scanline = 0;
+        scanline = scheduler.Register([&](uint64_t late) {
+            fired.push_back({ 'S', scheduler.GetCycle() - late });
+            scheduler.ScheduleIn(scanline, 456 - late);
+        });
+        auto timer = scheduler.Register([&](uint64_t late) { fired.push_back({ 'T', scheduler.GetCycle() - late }); });
+        auto never = scheduler.Register([&](uint64_t) { fired.push_back({ 'N', scheduler.GetCycle() }); });
+        scheduler.Schedule(scanline, 456);
+        scheduler.Schedule(timer, 1000);
+        scheduler.Schedule(never, 500);
+        scheduler.Deschedule(never);
+        CPPUNIT_ASSERT(!scheduler.IsScheduled(never));
+        // Moved earlier, and ties run in the order they were scheduled
+        scheduler.Schedule(timer, 912);
+        // Instructions of 12 cycles, overshooting the deadlines
+        while (scheduler.GetCycle() < 1400) {
+            while (scheduler.GetCycle() < scheduler.GetNextEventCycle() && scheduler.GetCycle() < 1400)
+                scheduler.AddCycles(12);
+            scheduler.RunEvents();
+        }
+        std::vector<std::pair<char, uint64_t>> expected = { { 'S', 456 }, { 'T', 912 }, { 'S', 912 }, { 'S', 1368 } };
+        CPPUNIT_ASSERT(fired == expected);
+        CPPUNIT_ASSERT_EQUAL(uint64_t(1824 - 1404), scheduler.SkipToNextEvent());
+        CPPUNIT_ASSERT_EQUAL(uint64_t(1824), scheduler.GetCycle());
+        // Ids that were never registered
+        CPPUNIT_ASSERT_THROW(scheduler.Schedule(3, 2000), std::runtime_error);
+        CPPUNIT_ASSERT_THROW(scheduler.Deschedule(TKPEmu::Scheduler::max_events), std::runtime_error);
+        CPPUNIT_ASSERT_THROW(scheduler.IsScheduled(-1), std::runtime_error);
+    }
+    void TestEmulator::testCatchUp() {
+        FakePpu lockstep, lazy;
+        TKPEmu::CatchUp<FakePpu> catch_up(lazy);
+        TKPEmu::Scheduler scheduler;
+        uint64_t interrupt_synced = 0;
+        auto stat = catch_up.RegisterSyncEvent(scheduler, [&](uint64_t) { interrupt_synced = catch_up.GetSyncedCycle(); });
+        scheduler.Schedule(stat, 1000);
+        for (uint64_t cycle = 0; cycle < 4000; cycle += 4) {
+            // Palette writes in the middle of a line
+            if (cycle % 300 == 0) {
+                catch_up.Sync(cycle);
+                lazy.Palette = cycle / 300;
+                lockstep.Palette = cycle / 300;
+            }
+            lockstep.RunCycles(cycle, cycle + 4);
+            scheduler.AddCycles(4);
+            scheduler.RunEvents();
+        }
+        catch_up.Sync(4000);
+        CPPUNIT_ASSERT(lockstep.Pixels == lazy.Pixels);
+        CPPUNIT_ASSERT_EQUAL(uint64_t(1000), interrupt_synced);
+        CPPUNIT_ASSERT(catch_up.GetSyncCount() < 20);
+    }
+    void TestEmulator::testIdleSkip() {
+        IdleEmulator lockstep, skipping;
+        skipping.SkipIdle = true;
+        lockstep.RunFrames(1);
+        skipping.RunFrames(1);
+        // Leaves the loop on the same cycle, without running it thousands of times
+        CPPUNIT_ASSERT_EQUAL(lockstep.GetCycleCount(), skipping.GetCycleCount());
+        CPPUNIT_ASSERT(skipping.Instructions < 10);
+        CPPUNIT_ASSERT_EQUAL(uint64_t(0), lockstep.GetMetrics().IdleSkips.load());
+        CPPUNIT_ASSERT_EQUAL(uint64_t(1), skipping.GetMetrics().IdleSkips.load());
+        CPPUNIT_ASSERT(skipping.GetMetrics().IdleSkippedCycles > 70000);
+        // A RunToCycle target inside the idle span stops the skip short of it
+        IdleEmulator to_cycle;
+        to_cycle.SkipIdle = true;
+        to_cycle.Control.RunToCycle(1000);
+        while (!to_cycle.IsPaused())
+            to_cycle.RunCycles(1);
+        CPPUNIT_ASSERT_EQUAL(uint64_t(1000), to_cycle.GetCycleCount());
+        CPPUNIT_ASSERT_EQUAL(uint64_t(1), to_cycle.GetMetrics().IdleSkips.load());
+    }
+    void TestEmulator::testAudioResampler() {
+        // One second of a 1kHz tone at 44.1kHz, mixed from two channels, in 735 frame chunks
+        constexpr size_t chunk = 735;
+        std::vector<int16_t> tone(chunk * 2), silence(chunk * 2, 1000);
+        TKPEmu::AudioMixer mixer;
+        TKPEmu::AudioResampler resampler(44100, 48000);
+        std::vector<int16_t> out;
+        for (size_t start = 0; start < 44100; start += chunk) {
+            for (size_t i = 0; i < chunk; i++) {
+                int16_t sample = std::lround(8000 * std::sin(2 * 3.14159265358979 * 1000 * (start + i) / 44100));
+                tone[i * 2] = sample;
+                tone[i * 2 + 1] = -sample;
+            }
+            mixer.Begin(chunk);
+            mixer.Add(tone.data(), chunk, 1.0f);
+            // Cancels out against the second call
+            mixer.Add(silence.data(), chunk, 0.5f);
+            mixer.Add(silence.data(), chunk, -0.5f);
+            resampler.Process(mixer.GetData(), chunk, out);
+        }
+        // Everything but the filter delay came out, at the new rate
+        size_t frames = out.size() / 2;
+        CPPUNIT_ASSERT(frames > 48000 - 40 && frames <= 48000);
+        int crossings = 0;
+        int peak = 0;
+        for (size_t i = 100; i < frames; i++) {
+            crossings += (out[(i - 1) * 2] < 0) != (out[i * 2] < 0);
+            peak = std::max(peak, std::abs(int(out[i * 2])));
+            CPPUNIT_ASSERT(std::abs(out[i * 2] + out[i * 2 + 1]) <= 1);
+        }
+        CPPUNIT_ASSERT(std::abs(crossings - int(2000 * (frames - 100) / 48000)) <= 2);
+        CPPUNIT_ASSERT(std::abs(peak - 8000) < 80);
+        // Speeding up by 1% produces 1% fewer samples
+        out.clear();
+        resampler.Reset();
+        resampler.SetRatioAdjust(0.99);
+        std::vector<float> input(44100 * 2);
+        resampler.Process(input.data(), 44100, out);
+        CPPUNIT_ASSERT(std::abs(int(out.size() / 2) - 47520) <= 20);
+        CPPUNIT_ASSERT_THROW(resampler.SetRatioAdjust(0), std::runtime_error);
+        CPPUNIT_ASSERT_THROW(resampler.SetRatioAdjust(-1), std::runtime_error);
+        CPPUNIT_ASSERT_THROW(resampler.SetRatioAdjust(1e12), std::runtime_error);
+    }
+    void TestEmulator::testScreenshot() {
+        FakeEmulator emulator;
+        emulator.SetWidth(16);
+        emulator.SetHeight(8);
+        for (size_t i = 0; i < emulator.Screen.size(); i++)
+            emulator.Screen[i] = i / 4;
+        auto directory = std::filesystem::temp_directory_path() / "tkp_screenshot_test";
+        std::filesystem::remove_all(directory);
+        emulator.Screenshot("shot.png", directory.string());
+        // The frame was copied, drawing into the screen right away doesn't change the file
+        auto expected = emulator.Screen;
+        std::fill(emulator.Screen.begin(), emulator.Screen.end(), 0);
+        TKPEmu::Emulator::WaitForScreenshots();
+        std::ifstream ifs(directory / "shot.png", std::ios::binary);
+        std::vector<uint8_t> written((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+        uint32_t width = 0, height = 0;
+        std::vector<uint8_t> pixels;
+        CPPUNIT_ASSERT(decode_png(written, width, height, pixels));
+        CPPUNIT_ASSERT_EQUAL(uint32_t(16), width);
+        CPPUNIT_ASSERT_EQUAL(uint32_t(8), height);
+        CPPUNIT_ASSERT(pixels == expected);
+        // A flipped bit anywhere in a chunk fails its CRC
+        written[written.size() / 2] ^= 1;
+        CPPUNIT_ASSERT(!decode_png(written, width, height, pixels));
+        std::filesystem::remove_all(directory);
+    }
+    void TestEmulator::testAVRecording() {
+        FakeEmulator emulator;
+        auto directory = std::filesystem::temp_directory_path() / "tkp_av_test";
+        std::filesystem::remove_all(directory);
+        auto path = (directory / "capture").string();
+        // No screen size yet, so there's nothing to record
+        CPPUNIT_ASSERT_THROW(emulator.StartAVRecording(path), std::runtime_error);
+        emulator.SetWidth(16);
+        emulator.SetHeight(8);
+        emulator.Audio.assign(800 * 2, 1000);
+        emulator.StartAVRecording(path);
+        // Gray frames, each a different shade, so Y is the shade and U and V are neutral
+        for (int frame = 0; frame < 3; frame++) {
+            std::fill(emulator.Screen.begin(), emulator.Screen.end(), 50 * (frame + 1));
+            emulator.RunFrames(1);
+        }
+        // A repeated frame is written again without being converted
+        emulator.RunFrames(1);
+        emulator.StopAVRecording();
+        // Frames after the recording stopped are not written
+        emulator.RunFrames(1);
+        auto stats = emulator.GetAVRecordingStats();
+        CPPUNIT_ASSERT_EQUAL(uint64_t(4), stats.Frames);
+        CPPUNIT_ASSERT_EQUAL(uint64_t(1), stats.Repeated);
+        CPPUNIT_ASSERT_EQUAL(uint64_t(3200), stats.AudioFrames);
+        std::ifstream video(path + ".y4m", std::ios::binary);
+        std::vector<uint8_t> y4m((std::istreambuf_iterator<char>(video)), std::istreambuf_iterator<char>());
+        std::string header = "YUV4MPEG2 W16 H8 F60:1 Ip A1:1 C444 XCOLORRANGE=FULL\n";
+        size_t plane = 16 * 8;
+        size_t frame_size = 6 + plane * 3;
+        CPPUNIT_ASSERT_EQUAL(header.size() + frame_size * 4, y4m.size());
+        CPPUNIT_ASSERT(std::equal(header.begin(), header.end(), y4m.begin()));
+        for (int frame = 0; frame < 4; frame++) {
+            size_t start = header.size() + frame * frame_size;
+            int shade = 50 * (std::min(frame, 2) + 1);
+            CPPUNIT_ASSERT(std::string(y4m.begin() + start, y4m.begin() + start + 6) == "FRAME\n");
+            CPPUNIT_ASSERT_EQUAL(shade, int(y4m[start + 6]));
+            CPPUNIT_ASSERT_EQUAL(128, int(y4m[start + 6 + plane]));
+            CPPUNIT_ASSERT_EQUAL(128, int(y4m[start + 6 + plane * 2]));
+        }
+        std::ifstream audio(path + ".wav", std::ios::binary);
+        std::vector<uint8_t> wav((std::istreambuf_iterator<char>(audio)), std::istreambuf_iterator<char>());
+        CPPUNIT_ASSERT_EQUAL(size_t(44 + 3200 * 4), wav.size());
+        uint32_t data_size = wav[40] | (wav[41] << 8) | (wav[42] << 16) | (wav[43] << 24);
+        CPPUNIT_ASSERT_EQUAL(uint32_t(3200 * 4), data_size);
+        CPPUNIT_ASSERT_EQUAL(1000, int(int16_t(wav[44] | (wav[45] << 8))));
+        // With two slots the pushes keep waiting for the writer, and still never allocate
+        TKPEmu::AVRecorder recorder(2);
+        recorder.Start(path, 16, 8);
+        std::vector<uint8_t> frame(16 * 8 * 4, 7);
+        auto before = TKPEmu::Tools::GetThreadAllocations().Allocations;
+        for (int i = 0; i < 20; i++) {
+            recorder.PushVideo(frame.data(), 16, 8);
+            recorder.PushAudio(emulator.Audio.data(), 800);
+        }
+        auto after = TKPEmu::Tools::GetThreadAllocations().Allocations;
+        recorder.Stop();
+        CPPUNIT_ASSERT_EQUAL(before, after);
+        CPPUNIT_ASSERT_EQUAL(uint64_t(20), recorder.GetStats().Frames);
+        std::filesystem::remove_all(directory);
+    }
+    void TestEmulator::testFrameDedup() {
+        FakeEmulator emulator;
+        emulator.SetWidth(16);
+        emulator.SetHeight(8);
+        // The first frame is always presented
+        CPPUNIT_ASSERT(emulator.ConsumeFrame());
+        CPPUNIT_ASSERT(!emulator.ConsumeFrame());
+        emulator.Screen[37] = 1;
+        CPPUNIT_ASSERT(emulator.ConsumeFrame());
+        CPPUNIT_ASSERT(!emulator.ConsumeFrame());
+        CPPUNIT_ASSERT(emulator.ConsumeFrame(true));
+        const auto& metrics = emulator.GetMetrics();
+        CPPUNIT_ASSERT_EQUAL(uint64_t(3), metrics.PresentedFrames.load());
+        CPPUNIT_ASSERT_EQUAL(uint64_t(2), metrics.SkippedFrames.load());
+    }
+    void TestEmulator::testSteadyStateAllocations() {
+        // Only meaningful in a TKP_TRACK_ALLOCATIONS build, elsewhere nothing is counted
+        FakeEmulator emulator;
+        emulator.SetWidth(16);
+        emulator.SetHeight(8);
+        emulator.Audio.assign(800 * 2, 0);
+        emulator.RunFrames(200);
+        const auto& metrics = emulator.GetMetrics();
+        CPPUNIT_ASSERT_EQUAL(uint64_t(0), metrics.AllocatingFrames.load());
+        CPPUNIT_ASSERT_EQUAL(uint64_t(0), metrics.SteadyStateAllocations.load());
+    }
+    void TestEmulator::testEmulatorRunner() {
+        using namespace std::chrono;
+        TKPEmu::EmulatorRunner runner;
+        auto emulator = std::make_shared<LoopingEmulator>();
+        runner.Start(emulator);
+        while (!emulator->Started.load())
+            std::this_thread::yield();
+        CPPUNIT_ASSERT(runner.IsRunning());
+        auto start = steady_clock::now();
+        CPPUNIT_ASSERT(runner.Stop());
+        CPPUNIT_ASSERT(steady_clock::now() - start < milliseconds(100));
+        CPPUNIT_ASSERT(!runner.IsRunning());
+        // A core that ignores Close is given up on at the deadline instead of hanging the caller
+        auto stuck = std::make_shared<LoopingEmulator>();
+        stuck->Stuck.store(true);
+        runner.Start(stuck);
+        while (!stuck->Started.load())
+            std::this_thread::yield();
+        start = steady_clock::now();
+        CPPUNIT_ASSERT(!runner.Stop(milliseconds(50)));
+        auto elapsed = steady_clock::now() - start;
+        CPPUNIT_ASSERT(elapsed >= milliseconds(50) && elapsed < milliseconds(500));
+        // The detached thread still owns the emulator and exits once it gets unstuck
+        stuck->Stuck.store(false);
+        while (stuck.use_count() > 1)
+            std::this_thread::sleep_for(milliseconds(1));
+    }
+    CPPUNIT_TEST_SUITE_REGISTRATION(TestEmulator);
+}
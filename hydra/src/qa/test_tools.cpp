@@ -0,0 +1,703 @@
+#include <cppunit/extensions/HelperMacros.h>
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include <lib/block_cache.hxx>
+#include <lib/executable_memory.hxx>
+#include <lib/cached_interpreter.hxx>
+#include <lib/vector_lanes.hxx>
+#include <lib/spsc_queue.hxx>
+#include <lib/threadpool.hxx>
+#include <lib/fastmem.hxx>
+#include <lib/threaded_dispatch.hxx>
+#include <lib/page_table.hxx>
+#include <lib/tile_decode.hxx>
+#include <lib/band_limited_buffer.hxx>
+#include <lib/upscale.hxx>
+#include <lib/alloc_tracker.hxx>
+#include <include/gb_scanline_renderer.hxx>
+#include <include/nes_mappers.hxx>
+
+namespace TKPEmu::QA {
+    // Toy CPU with three opcodes: 0 increments the accumulator, 1 jumps to the next byte
+    // and 2 stores the accumulator at the address in the next byte
+    struct ToyCpu {
+        using Instruction = TKPEmu::Tools::DecodedInstruction<ToyCpu>;
+        std::array<uint8_t, 256> Memory {};
+        uint8_t A = 0;
+        uint8_t PC = 0;
+        int Decoded = 0;
+        TKPEmu::Tools::CachedInterpreter<ToyCpu, 8, 4> Interpreter;
+        bool Decode(uint64_t location, Instruction& out) {
+            Decoded++;
+            out.Operand = Memory[(location + 1) & 0xFF];
+            switch (Memory[location]) {
+                case 0: {
+                    out.Execute = [](ToyCpu& cpu, const Instruction&) { cpu.A++; cpu.PC++; return true; };
+                    out.Length = 1;
+                    return false;
+                }
+                case 1: {
+                    out.Execute = [](ToyCpu& cpu, const Instruction& i) { cpu.PC = i.Operand; return false; };
+                    out.Length = 2;
+                    return true;
+                }
+                default: {
+                    out.Execute = [](ToyCpu& cpu, const Instruction& i) {
+                        cpu.Memory[i.Operand] = cpu.A;
+                        cpu.Interpreter.InvalidateWrite(i.Operand);
+                        cpu.PC += 2;
+                        return true;
+                    };
+                    out.Length = 2;
+                    return false;
+                }
+            }
+        }
+        void Run() { Interpreter.Run(*this, PC); }
+    };
+    // Accumulator machine for the dispatch macros, unknown opcodes halt
+    struct DispatchCpu {
+        #define DISPATCH_CPU_HANDLERS(X) X(HALT) X(INC) X(DEC) X(DOUBLE)
+        enum Handler { DISPATCH_CPU_HANDLERS(TKP_HANDLER_ENUM) };
+        #define DISPATCH_CPU_OPCODES(X) X(0x10, INC) X(0x11, INC) X(0x20, DEC) X(0x30, DOUBLE)
+        static constexpr auto decode_table = TKPEmu::Tools::MakeDecodeTable<256>(HALT, { DISPATCH_CPU_OPCODES(TKP_OPCODE_ENTRY) });
+        std::vector<uint8_t> Program;
+        size_t PC = 0;
+        int A = 0;
+        uint8_t next() { return decode_table[Program[PC++]]; }
+        void Run() {
+            TKP_DISPATCH_BEGIN(DISPATCH_CPU_HANDLERS, next())
+            TKP_HANDLER(INC) { A++; TKP_DISPATCH(next()); }
+            TKP_HANDLER(DEC) { A--; TKP_DISPATCH(next()); }
+            TKP_HANDLER(DOUBLE) { A *= 2; TKP_DISPATCH(next()); }
+            TKP_HANDLER(HALT) { TKP_DISPATCH_EXIT; }
+            TKP_DISPATCH_END
+        }
+    };
+    // Two switchable 256 byte banks at 0x000, a register at 0x300 selects the bank
+    struct PagedMemory {
+        std::array<uint8_t, 0x200> Banks {};
+        std::array<uint8_t, 0x100> Ram {};
+        std::vector<uint32_t> IoAccesses;
+        TKPEmu::Tools::PageTable<PagedMemory, 10, 8> Pages { *this };
+        PagedMemory() {
+            Pages.MapRead(0x000, 0x100, Banks.data());
+            Pages.Map(0x100, 0x100, Ram.data());
+        }
+        uint8_t IoRead(uint32_t address) {
+            IoAccesses.push_back(address);
+            return 0xFF;
+        }
+        void IoWrite(uint32_t address, uint8_t data) {
+            IoAccesses.push_back(address);
+            if (address == 0x300)
+                Pages.MapRead(0x000, 0x100, Banks.data() + (data & 1) * 0x100);
+        }
+    };
+    // Pixel at a time DMG renderer, the way the pixel FIFO sees the line
+    uint8_t reference_pixel(const uint8_t* vram, const TKPEmu::Gameboy::OamEntry* oam,
+            const TKPEmu::Gameboy::ScanlineRegisters& regs, int x) {
+        auto tile_pixel = [&](uint16_t map_base, int px, int py) {
+            uint8_t tile = vram[map_base + (py / 8) * 32 + (px / 8)];
+            uint16_t address = (regs.LCDC & 0x10) ? tile * 16 : 0x1000 + int8_t(tile) * 16;
+            address += (py % 8) * 2;
+            int bit = 7 - px % 8;
+            return ((vram[address] >> bit) & 1) | (((vram[address + 1] >> bit) & 1) << 1);
+        };
+        int bg = 0;
+        if (regs.LCDC & 0x01) {
+            if ((regs.LCDC & 0x20) && regs.LY >= regs.WY && regs.WX <= 166 && x >= regs.WX - 7)
+                bg = tile_pixel((regs.LCDC & 0x40) ? 0x1C00 : 0x1800, x - (regs.WX - 7), regs.WindowLine);
+            else
+                bg = tile_pixel((regs.LCDC & 0x08) ? 0x1C00 : 0x1800, (x + regs.SCX) & 0xFF, (regs.LY + regs.SCY) & 0xFF);
+        }
+        int height = (regs.LCDC & 0x04) ? 16 : 8;
+        int selected = 0;
+        const TKPEmu::Gameboy::OamEntry* best = nullptr;
+        int best_color = 0;
+        for (int i = 0; i < 40 && selected < 10 && (regs.LCDC & 0x02); i++) {
+            int row = regs.LY - (oam[i].Y - 16);
+            if (row < 0 || row >= height)
+                continue;
+            selected++;
+            int px = x - (oam[i].X - 8);
+            if (px < 0 || px >= 8)
+                continue;
+            if (oam[i].Flags & 0x40)
+                row = height - 1 - row;
+            if (oam[i].Flags & 0x20)
+                px = 7 - px;
+            uint16_t address = (height == 16 ? oam[i].Tile & 0xFE : oam[i].Tile) * 16 + row * 2;
+            int color = ((vram[address] >> (7 - px)) & 1) | (((vram[address + 1] >> (7 - px)) & 1) << 1);
+            if (color && (!best || oam[i].X < best->X)) {
+                best = &oam[i];
+                best_color = color;
+            }
+        }
+        if (best && !((best->Flags & 0x80) && bg))
+            return (((best->Flags & 0x10) ? regs.OBP1 : regs.OBP0) >> (best_color * 2)) & 3;
+        return (regs.LCDC & 0x01) ? (regs.BGP >> (bg * 2)) & 3 : 0;
+    }
+    class TestTools : public CppUnit::TestFixture {
+        void testBlockCacheInvalidation();
+        void testExecutableMemory();
+        void testCachedInterpreter();
+        void testVectorLanesDifferential();
+        void testSPSCQueue();
+        void testWorkerPoolBands();
+        void testFastmem();
+        void testThreadedDispatch();
+        void testNESMappers();
+        void testPageTable();
+        void testTileDecodeDifferential();
+        void testScanlineRenderer();
+        void testBandLimitedBuffer();
+        void testUpscale();
+        void testAllocationTracker();
+        CPPUNIT_TEST_SUITE(TestTools);
+        CPPUNIT_TEST(testBlockCacheInvalidation);
+        CPPUNIT_TEST(testExecutableMemory);
+        CPPUNIT_TEST(testCachedInterpreter);
+        CPPUNIT_TEST(testVectorLanesDifferential);
+        CPPUNIT_TEST(testSPSCQueue);
+        CPPUNIT_TEST(testWorkerPoolBands);
+        CPPUNIT_TEST(testFastmem);
+        CPPUNIT_TEST(testThreadedDispatch);
+        CPPUNIT_TEST(testNESMappers);
+        CPPUNIT_TEST(testPageTable);
+        CPPUNIT_TEST(testTileDecodeDifferential);
+        CPPUNIT_TEST(testScanlineRenderer);
+        CPPUNIT_TEST(testBandLimitedBuffer);
+        CPPUNIT_TEST(testUpscale);
+        CPPUNIT_TEST(testAllocationTracker);
+        CPPUNIT_TEST_SUITE_END();
+    };
+    void TestTools::testBlockCacheInvalidation() {
+        TKPEmu::Tools::BlockCache<int, 24, 12> cache;
+        cache.Insert(0x1000, 0x20, 1);
+        // Spans the page boundary at 0x3000
+        cache.Insert(0x2FF0, 0x20, 2);
+        cache.Insert(0x5000, 0x10, 3);
+        CPPUNIT_ASSERT_EQUAL(1, *cache.Find(0x1000));
+        CPPUNIT_ASSERT(cache.Find(0x1004) == nullptr);
+        // Writes to pages without code don't invalidate anything
+        cache.InvalidateWrite(0x4123);
+        CPPUNIT_ASSERT_EQUAL(size_t(3), cache.GetBlockCount());
+        cache.InvalidateWrite(0x3008);
+        CPPUNIT_ASSERT(cache.Find(0x2FF0) == nullptr);
+        CPPUNIT_ASSERT(cache.Find(0x1000) != nullptr);
+        CPPUNIT_ASSERT(cache.Find(0x5000) != nullptr);
+        cache.InvalidateWrite(0x1FFF);
+        CPPUNIT_ASSERT(cache.Find(0x1000) == nullptr);
+        CPPUNIT_ASSERT_EQUAL(size_t(1), cache.GetBlockCount());
+        // Dropping a block through one page unlinks it from the others
+        cache.Insert(0x2FF0, 0x20, 2);
+        cache.InvalidateWrite(0x2FFF);
+        CPPUNIT_ASSERT_EQUAL(size_t(1), cache.GetRegistrationCount());
+        // Recompiling the same block over and over doesn't grow the page lists
+        for (int i = 0; i < 100; i++)
+            cache.Insert(0x5000, 0x10, 4 + i);
+        CPPUNIT_ASSERT_EQUAL(size_t(1), cache.GetRegistrationCount());
+        CPPUNIT_ASSERT_EQUAL(103, *cache.Find(0x5000));
+        // A block running off the end of the 24 bit space wraps around to page 0
+        cache.Insert(0xFFFFF8, 0x10, 5);
+        CPPUNIT_ASSERT_EQUAL(size_t(3), cache.GetRegistrationCount());
+        cache.InvalidateWrite(0x000004);
+        CPPUNIT_ASSERT(cache.Find(0xFFFFF8) == nullptr);
+        CPPUNIT_ASSERT_EQUAL(size_t(1), cache.GetRegistrationCount());
+    }
+    void TestTools::testExecutableMemory() {
+        TKPEmu::Tools::ExecutableMemory memory(4096);
+        CPPUNIT_ASSERT(memory.Allocate(8192) == nullptr);
+        uint8_t* code = memory.Allocate(6);
+        CPPUNIT_ASSERT(code != nullptr);
+        #if defined(__x86_64__) || defined(_M_X64)
+        // mov eax, 42; ret
+        const uint8_t bytes[] = { 0xB8, 42, 0, 0, 0, 0xC3 };
+        std::memcpy(code, bytes, sizeof(bytes));
+        memory.Protect();
+        auto func = reinterpret_cast<int(*)()>(code);
+        CPPUNIT_ASSERT_EQUAL(42, func());
+        memory.Unprotect();
+        #endif
+        memory.Reset();
+        CPPUNIT_ASSERT_EQUAL(size_t(0), memory.GetUsed());
+    }
+    void TestTools::testCachedInterpreter() {
+        ToyCpu cpu;
+        // 0x10: inc, inc, jmp 0x10
+        cpu.Memory[0x10] = 0;
+        cpu.Memory[0x11] = 0;
+        cpu.Memory[0x12] = 1;
+        cpu.Memory[0x13] = 0x10;
+        cpu.PC = 0x10;
+        for (int i = 0; i < 10; i++)
+            cpu.Run();
+        CPPUNIT_ASSERT_EQUAL(uint8_t(20), cpu.A);
+        // Decoded once, executed ten times
+        CPPUNIT_ASSERT_EQUAL(3, cpu.Decoded);
+        // 0x20: store A at 0x23, which turns the jmp's operand into the jump target 0x30
+        cpu.Memory[0x20] = 2;
+        cpu.Memory[0x21] = 0x23;
+        cpu.Memory[0x22] = 1;
+        cpu.Memory[0x23] = 0x10;
+        cpu.Memory[0x30] = 1;
+        cpu.Memory[0x31] = 0x30;
+        cpu.A = 0x30;
+        cpu.PC = 0x20;
+        cpu.Run();
+        // The block invalidated itself so it stopped after the store
+        CPPUNIT_ASSERT_EQUAL(uint8_t(0x22), cpu.PC);
+        cpu.Run();
+        CPPUNIT_ASSERT_EQUAL(uint8_t(0x30), cpu.PC);
+    }
+    void TestTools::testVectorLanesDifferential() {
+        using namespace TKPEmu::Tools;
+        const VectorLaneOps* reference = GetVectorLaneOps(VectorBackend::Scalar);
+        std::mt19937 rng(0x1234);
+        // Edge values get picked often so that saturation and sign handling are exercised
+        const int16_t edges[] = { 0, 1, -1, 0x7FFF, -0x8000, 0x7FFE, -0x7FFF, 0x100 };
+        auto random_lanes = [&]() {
+            VectorLanes v;
+            for (auto& lane : v.Lanes)
+                lane = (rng() & 3) ? static_cast<int16_t>(rng()) : edges[rng() & 7];
+            return v;
+        };
+        for (auto backend : { VectorBackend::SSE2 }) {
+            const VectorLaneOps* ops = GetVectorLaneOps(backend);
+            if (!ops)
+                continue;
+            using Binary = void (*VectorLaneOps::*)(VectorLanes&, const VectorLanes&, const VectorLanes&);
+            const Binary binaries[] = {
+                &VectorLaneOps::AddSaturate, &VectorLaneOps::SubSaturate, &VectorLaneOps::Add, &VectorLaneOps::Sub,
+                &VectorLaneOps::MulLow, &VectorLaneOps::MulHigh, &VectorLaneOps::MulHighUnsigned,
+                &VectorLaneOps::And, &VectorLaneOps::Or, &VectorLaneOps::Xor,
+                &VectorLaneOps::CompareLess, &VectorLaneOps::CompareEqual,
+            };
+            for (int i = 0; i < 10000; i++) {
+                VectorLanes a = random_lanes(), b = random_lanes(), mask = random_lanes();
+                VectorLanes expected, actual;
+                for (auto op : binaries) {
+                    (reference->*op)(expected, a, b);
+                    (ops->*op)(actual, a, b);
+                    CPPUNIT_ASSERT(expected.Lanes == actual.Lanes);
+                }
+                reference->Select(expected, mask, a, b);
+                ops->Select(actual, mask, a, b);
+                CPPUNIT_ASSERT(expected.Lanes == actual.Lanes);
+            }
+        }
+        // A block of ops dispatched once has to match the same ops run one by one
+        auto block = [&]<class Kernels>(const VectorLanes& a, const VectorLanes& b) {
+            VectorLanes sum, product, mask, out;
+            Kernels::AddSaturate(sum, a, b);
+            Kernels::MulHigh(product, a, b);
+            Kernels::CompareLess(mask, sum, product);
+            Kernels::Select(out, mask, sum, product);
+            return out;
+        };
+        for (int i = 0; i < 10000; i++) {
+            VectorLanes a = random_lanes(), b = random_lanes();
+            VectorLanes expected = block.template operator()<VectorKernels<VectorBackend::Scalar>>(a, b);
+            VectorLanes actual = WithVectorBackend([&]<class Kernels>() {
+                return block.template operator()<Kernels>(a, b);
+            });
+            CPPUNIT_ASSERT(expected.Lanes == actual.Lanes);
+        }
+    }
+    void TestTools::testSPSCQueue() {
+        TKPEmu::Tools::SPSCQueue<uint32_t, 64> queue;
+        constexpr uint32_t count = 100000;
+        std::thread producer([&queue]() {
+            for (uint32_t i = 0; i < count; i++) {
+                while (!queue.TryPush(i));
+            }
+        });
+        uint32_t expected = 0;
+        bool ordered = true;
+        while (expected < count) {
+            uint32_t item;
+            if (queue.TryPop(item)) {
+                ordered &= item == expected;
+                expected++;
+            }
+        }
+        producer.join();
+        CPPUNIT_ASSERT(ordered);
+        CPPUNIT_ASSERT(queue.IsEmpty());
+    }
+    void TestTools::testWorkerPoolBands() {
+        TKPEmu::Tools::WorkerPool pool(4);
+        CPPUNIT_ASSERT_EQUAL(4u, pool.GetWorkerCount());
+        std::array<std::atomic<int>, 240> rows {};
+        for (int frame = 0; frame < 100; frame++) {
+            pool.RunBands(rows.size(), 8, [&rows](unsigned first, unsigned last) {
+                for (unsigned y = first; y < last; y++)
+                    rows[y]++;
+            });
+        }
+        for (auto& row : rows)
+            CPPUNIT_ASSERT_EQUAL(100, row.load());
+    }
+    void TestTools::testFastmem() {
+        using TKPEmu::Tools::Fastmem;
+        if (!Fastmem::IsSupported())
+            return;
+        Fastmem fastmem(0x800000);
+        fastmem.MapRam(0, 0x800000, 0);
+        // Mirror of the first page
+        fastmem.MapRam(0x1FC00000, Fastmem::page_size, 0);
+        auto slow_read = [](uint32_t) { return uint32_t(0xDEADBEEF); };
+        auto slow_write = [](uint32_t, uint32_t) {};
+        fastmem.Write<uint32_t>(0x10, 0x12345678, slow_write);
+        CPPUNIT_ASSERT_EQUAL(uint32_t(0x12345678), fastmem.Read<uint32_t>(0x1FC00010, slow_read));
+        CPPUNIT_ASSERT_EQUAL(uint32_t(0x12345678), *reinterpret_cast<uint32_t*>(fastmem.GetRam() + 0x10));
+        // MMIO
+        CPPUNIT_ASSERT(!fastmem.IsMapped(0x04400000));
+        CPPUNIT_ASSERT_EQUAL(uint32_t(0xDEADBEEF), fastmem.Read<uint32_t>(0x04400000, slow_read));
+        // A raw access to an unmapped page goes to the fault handler, which maps it on demand
+        int faults = 0;
+        fastmem.SetFaultHandler([&](uint32_t address, void*) {
+            faults++;
+            fastmem.MapRam(address & ~(Fastmem::page_size - 1), Fastmem::page_size, 0);
+            return true;
+        });
+        volatile uint32_t* raw = reinterpret_cast<volatile uint32_t*>(fastmem.GetBase() + 0x04400010);
+        CPPUNIT_ASSERT_EQUAL(uint32_t(0x12345678), uint32_t(*raw));
+        CPPUNIT_ASSERT_EQUAL(1, faults);
+        fastmem.Unmap(0x04400000, Fastmem::page_size);
+        CPPUNIT_ASSERT(!fastmem.IsMapped(0x04400000));
+        // Accesses running into an unmapped page or off the top of the address space are slow
+        CPPUNIT_ASSERT_EQUAL(uint32_t(0xDEADBEEF), fastmem.Read<uint32_t>(0x7FFFFE, slow_read));
+        fastmem.MapRam(0xFFFFF000, Fastmem::page_size, 0);
+        CPPUNIT_ASSERT_EQUAL(uint32_t(0xDEADBEEF), fastmem.Read<uint32_t>(0xFFFFFFFE, slow_read));
+        CPPUNIT_ASSERT_EQUAL(uint32_t(0x12345678), fastmem.Read<uint32_t>(0xFFFFF010, slow_read));
+        uint32_t slow_written = 0;
+        fastmem.Write<uint32_t>(0x7FFFFD, 1, [&](uint32_t address, uint32_t) { slow_written = address; });
+        CPPUNIT_ASSERT_EQUAL(uint32_t(0x7FFFFD), slow_written);
+        // A constructor that throws gives back its descriptor and mappings
+        auto open_fds = []() {
+            return std::distance(std::filesystem::directory_iterator("/proc/self/fd"), std::filesystem::directory_iterator());
+        };
+        std::vector<std::unique_ptr<Fastmem>> others;
+        for (int i = 0; i < 3; i++)
+            others.push_back(std::make_unique<Fastmem>(Fastmem::page_size));
+        auto fds = open_fds();
+        CPPUNIT_ASSERT_THROW(Fastmem(Fastmem::page_size), std::runtime_error);
+        CPPUNIT_ASSERT_EQUAL(fds, open_fds());
+    }
+    void TestTools::testThreadedDispatch() {
+        static_assert(DispatchCpu::decode_table[0x11] == DispatchCpu::INC);
+        static_assert(DispatchCpu::decode_table[0x12] == DispatchCpu::HALT);
+        DispatchCpu cpu;
+        cpu.Program = { 0x10, 0x11, 0x30, 0x20, 0x30, 0xFF, 0x10 };
+        cpu.Run();
+        CPPUNIT_ASSERT_EQUAL(6, cpu.A);
+        CPPUNIT_ASSERT_EQUAL(size_t(6), cpu.PC);
+    }
+    void TestTools::testNESMappers() {
+        using namespace TKPEmu::NES;
+        // 256KB PRG and 32KB CHR, every byte holds the number of its 16KB or 4KB bank
+        Cartridge cartridge;
+        for (int i = 0; i < 0x40000; i++)
+            cartridge.Prg.push_back(i / 0x4000);
+        for (int i = 0; i < 0x8000; i++)
+            cartridge.Chr.push_back(i / 0x1000);
+        MMC1 mmc1(cartridge);
+        CPPUNIT_ASSERT_EQUAL(uint8_t(0), mmc1.CpuRead(0x8000));
+        CPPUNIT_ASSERT_EQUAL(uint8_t(15), mmc1.CpuRead(0xFFFF));
+        auto serial_write = [&](uint16_t address, uint8_t value) {
+            for (int i = 0; i < 5; i++)
+                mmc1.CpuWrite(address, value >> i);
+        };
+        serial_write(0xE000, 5);
+        CPPUNIT_ASSERT_EQUAL(uint8_t(5), mmc1.CpuRead(0x8000));
+        CPPUNIT_ASSERT_EQUAL(uint8_t(5), mmc1.CpuRead(0xBFFF));
+        CPPUNIT_ASSERT_EQUAL(uint8_t(15), mmc1.CpuRead(0xC000));
+        // 4KB CHR mode, vertical mirroring
+        serial_write(0x8000, 0x1E);
+        serial_write(0xA000, 3);
+        serial_write(0xC000, 6);
+        CPPUNIT_ASSERT_EQUAL(uint8_t(3), mmc1.PpuRead(0x0000));
+        CPPUNIT_ASSERT_EQUAL(uint8_t(6), mmc1.PpuRead(0x1FFF));
+        CPPUNIT_ASSERT(mmc1.GetMirroring() == Mirroring::Vertical);
+        // A reset write in the middle of a sequence drops the bits written so far
+        mmc1.CpuWrite(0xE000, 1);
+        mmc1.CpuWrite(0xE000, 0x80);
+        serial_write(0xE000, 2);
+        CPPUNIT_ASSERT_EQUAL(uint8_t(2), mmc1.CpuRead(0x8000));
+        // UxROM has no CHR banking, so it can't take the 32KB of CHR
+        CPPUNIT_ASSERT_THROW(UxROM uxrom(cartridge), std::runtime_error);
+        cartridge.Chr.resize(0x2000);
+        int number = VisitMapper(2, cartridge, [](auto& mapper) {
+            mapper.CpuWrite(0x8000, 7);
+            CPPUNIT_ASSERT_EQUAL(uint8_t(7), mapper.CpuRead(0x8000));
+            CPPUNIT_ASSERT_EQUAL(uint8_t(15), mapper.CpuRead(0xC000));
+            return std::remove_reference_t<decltype(mapper)>::Number;
+        });
+        CPPUNIT_ASSERT_EQUAL(2, number);
+        CPPUNIT_ASSERT_THROW(VisitMapper(99, cartridge, [](auto&) {}), std::runtime_error);
+        // 8KB NROM, the one PRG page shows up in all four windows
+        Cartridge small;
+        for (int i = 0; i < 0x2000; i++)
+            small.Prg.push_back(i & 0xFF);
+        small.Chr.resize(0x2000);
+        NROM nrom(small);
+        for (uint16_t address : { 0x8000, 0xA000, 0xC000, 0xE000 })
+            CPPUNIT_ASSERT_EQUAL(uint8_t(0x34), nrom.CpuRead(address + 0x34));
+        CPPUNIT_ASSERT_EQUAL(uint8_t(0xFF), nrom.CpuRead(0xFFFF));
+        small.Prg.resize(0x10000);
+        CPPUNIT_ASSERT_THROW(NROM too_big(small), std::runtime_error);
+        // 48KB MMC1 in 32KB mode, bank 1 starts at 32KB and wraps around to the start
+        Cartridge odd;
+        for (int i = 0; i < 0xC000; i++)
+            odd.Prg.push_back(i / 0x2000);
+        odd.Chr.resize(0x2000);
+        MMC1 odd_mmc1(odd);
+        auto odd_write = [&](uint16_t address, uint8_t value) {
+            for (int i = 0; i < 5; i++)
+                odd_mmc1.CpuWrite(address, value >> i);
+        };
+        odd_write(0x8000, 0x00);
+        odd_write(0xE000, 2);
+        const uint8_t pages[] = { 4, 5, 0, 1 };
+        for (int i = 0; i < 4; i++)
+            CPPUNIT_ASSERT_EQUAL(pages[i], odd_mmc1.CpuRead(0x8000 + i * 0x2000));
+        CPPUNIT_ASSERT_EQUAL(uint8_t(1), odd_mmc1.CpuRead(0xFFFF));
+    }
+    void TestTools::testPageTable() {
+        PagedMemory memory;
+        memory.Banks[0x010] = 1;
+        memory.Banks[0x110] = 2;
+        CPPUNIT_ASSERT_EQUAL(uint8_t(1), memory.Pages.Read(0x010));
+        memory.Pages.Write(0x150, 42);
+        CPPUNIT_ASSERT_EQUAL(uint8_t(42), memory.Ram[0x50]);
+        CPPUNIT_ASSERT(memory.IoAccesses.empty());
+        // Writes to read only pages and accesses to unmapped pages go to the handler
+        memory.Pages.Write(0x010, 5);
+        CPPUNIT_ASSERT_EQUAL(uint8_t(1), memory.Pages.Read(0x010));
+        CPPUNIT_ASSERT_EQUAL(uint8_t(0xFF), memory.Pages.Read(0x2AB));
+        memory.Pages.Write(0x300, 1);
+        CPPUNIT_ASSERT_EQUAL(uint8_t(2), memory.Pages.Read(0x010));
+        std::vector<uint32_t> expected = { 0x010, 0x2AB, 0x300 };
+        CPPUNIT_ASSERT(memory.IoAccesses == expected);
+        memory.Pages.Unmap(0x100, 0x100);
+        memory.Pages.Read(0x150);
+        CPPUNIT_ASSERT_EQUAL(size_t(4), memory.IoAccesses.size());
+    }
+    void TestTools::testTileDecodeDifferential() {
+        using namespace TKPEmu::Tools;
+        std::mt19937 rng(42);
+        std::vector<uint8_t> rows(2 * 37);
+        for (auto& byte : rows)
+            byte = rng();
+        const auto* reference = GetTileDecodeOps(TileBackend::Scalar);
+        std::vector<uint8_t> expected(8 * 37), expected_flipped(8 * 37);
+        reference->DecodeRows(rows.data(), 37, expected.data());
+        reference->DecodeRowsFlipped(rows.data(), 37, expected_flipped.data());
+        // 0x80 in the low plane and 0x01 in the high plane
+        uint8_t row[2] = { 0x80, 0x01 };
+        uint8_t pixels[8];
+        reference->DecodeRows(row, 1, pixels);
+        CPPUNIT_ASSERT_EQUAL(uint8_t(1), pixels[0]);
+        CPPUNIT_ASSERT_EQUAL(uint8_t(2), pixels[7]);
+        for (auto backend : { TileBackend::SSSE3, TileBackend::BMI2 }) {
+            const auto* ops = GetTileDecodeOps(backend);
+            if (!ops)
+                continue;
+            // Odd count so the two row SIMD loop also has a remainder
+            std::vector<uint8_t> out(8 * 37), out_flipped(8 * 37);
+            ops->DecodeRows(rows.data(), 37, out.data());
+            ops->DecodeRowsFlipped(rows.data(), 37, out_flipped.data());
+            CPPUNIT_ASSERT(out == expected);
+            CPPUNIT_ASSERT(out_flipped == expected_flipped);
+        }
+    }
+    void TestTools::testScanlineRenderer() {
+        using namespace TKPEmu::Gameboy;
+        std::mt19937 rng(7);
+        std::vector<uint8_t> vram(0x2000);
+        std::array<OamEntry, 40> oam;
+        ScanlineRenderer renderer;
+        for (int line = 0; line < 2000; line++) {
+            for (auto& byte : vram)
+                byte = rng();
+            for (auto& sprite : oam)
+                sprite = { uint8_t(rng() % 176), uint8_t(rng() % 176), uint8_t(rng()), uint8_t(rng()) };
+            ScanlineRegisters regs;
+            regs.LCDC = rng() | 0x80;
+            regs.LY = rng() % 144;
+            regs.SCX = rng();
+            regs.SCY = rng();
+            regs.WY = rng() % 160;
+            regs.WX = rng() % 176;
+            regs.BGP = rng();
+            regs.OBP0 = rng();
+            regs.OBP1 = rng();
+            regs.WindowLine = rng() % 144;
+            std::array<uint8_t, 160> out;
+            renderer.BeginLine();
+            CPPUNIT_ASSERT(renderer.CanBatch());
+            renderer.RenderLine(vram.data(), oam.data(), regs, out.data());
+            for (int x = 0; x < 160; x++)
+                CPPUNIT_ASSERT_EQUAL(reference_pixel(vram.data(), oam.data(), regs, x), out[x]);
+        }
+        // Only the first mid line write asks for the dot path to catch up
+        CPPUNIT_ASSERT(renderer.OnMidLineWrite());
+        CPPUNIT_ASSERT(!renderer.OnMidLineWrite());
+        CPPUNIT_ASSERT(!renderer.CanBatch());
+    }
+    void TestTools::testBandLimitedBuffer() {
+        constexpr uint32_t clock_rate = 4194304;
+        constexpr uint32_t frame_clocks = 70224;
+        TKPEmu::Tools::BandLimitedBuffer buffer(clock_rate, 48000, frame_clocks);
+        TKPEmu::Tools::BandLimitedChannel channel;
+        // A single step settles exactly at its height
+        channel.Update(buffer, 100, 10000);
+        buffer.EndFrame(frame_clocks);
+        std::vector<int16_t> samples(buffer.GetSamplesAvailable());
+        CPPUNIT_ASSERT(samples.size() >= 803 && samples.size() <= 804);
+        buffer.ReadSamples(samples.data(), samples.size());
+        CPPUNIT_ASSERT_EQUAL(int16_t(0), samples[0]);
+        CPPUNIT_ASSERT_EQUAL(int16_t(10000), samples.back());
+        // One second of a 1kHz square wave, only updating on edges
+        buffer.Clear();
+        channel = {};
+        uint64_t clock = 0;
+        uint64_t next_edge = 0;
+        bool high = false;
+        std::vector<int16_t> second;
+        for (int frame = 0; frame < 60; frame++) {
+            while (next_edge < clock + frame_clocks) {
+                high = !high;
+                channel.Update(buffer, next_edge - clock, high ? 8000 : -8000);
+                next_edge += clock_rate / 2000;
+            }
+            clock += frame_clocks;
+            buffer.EndFrame(frame_clocks);
+            size_t old_size = second.size();
+            second.resize(old_size + buffer.GetSamplesAvailable());
+            buffer.ReadSamples(second.data() + old_size, second.size() - old_size);
+        }
+        CPPUNIT_ASSERT(std::abs(int64_t(second.size()) - int64_t(48000) * 60 * frame_clocks / clock_rate) <= 1);
+        // Skipping the ringing ahead of the first edge, which starts from silence
+        int crossings = 0;
+        int64_t sum = 0;
+        for (size_t i = 16; i < second.size(); i++) {
+            crossings += (second[i - 1] < 0) != (second[i] < 0);
+            sum += second[i];
+        }
+        int64_t expected = int64_t(2000) * 60 * frame_clocks / clock_rate;
+        CPPUNIT_ASSERT(std::abs(crossings - expected) <= 2);
+        CPPUNIT_ASSERT(std::abs(sum / int64_t(second.size())) < 100);
+        // Two unread frames fit, a third one would run past the end
+        buffer.Clear();
+        buffer.EndFrame(frame_clocks);
+        buffer.EndFrame(frame_clocks);
+        CPPUNIT_ASSERT_THROW(buffer.EndFrame(frame_clocks), std::runtime_error);
+        samples.resize(buffer.GetSamplesAvailable());
+        CPPUNIT_ASSERT_EQUAL(samples.size(), buffer.ReadSamples(samples.data(), samples.size()));
+    }
+    // Plain Scale2x with clamped edges, to check the SSE path against
+    std::vector<uint32_t> reference_scale2x(const std::vector<uint32_t>& src, int width, int height) {
+        std::vector<uint32_t> out(src.size() * 4);
+        auto at = [&](int x, int y) {
+            return src[std::clamp(y, 0, height - 1) * width + std::clamp(x, 0, width - 1)];
+        };
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                uint32_t b = at(x, y - 1), d = at(x - 1, y), e = at(x, y), f = at(x + 1, y), h = at(x, y + 1);
+                bool active = b != h && d != f;
+                out[(y * 2) * width * 2 + x * 2] = active && d == b ? d : e;
+                out[(y * 2) * width * 2 + x * 2 + 1] = active && b == f ? f : e;
+                out[(y * 2 + 1) * width * 2 + x * 2] = active && d == h ? d : e;
+                out[(y * 2 + 1) * width * 2 + x * 2 + 1] = active && h == f ? f : e;
+            }
+        }
+        return out;
+    }
+    void TestTools::testUpscale() {
+        using TKPEmu::Tools::UpscaleFilter;
+        // Odd sizes so that the vector loops have leftovers, and few colors so that the
+        // equality rules fire often
+        constexpr int width = 37, height = 19;
+        std::mt19937 rng(7);
+        const uint32_t colors[] = { 0xFF000000, 0xFFFFFFFF, 0xFF2080C0 };
+        std::vector<uint32_t> src(width * height);
+        for (auto& pixel : src)
+            pixel = colors[rng() % 3];
+        TKPEmu::Tools::WorkerPool single(1);
+        TKPEmu::Tools::WorkerPool several(3);
+        TKPEmu::Tools::Upscaler upscaler(single);
+        TKPEmu::Tools::Upscaler threaded(several);
+        auto run = [&](TKPEmu::Tools::Upscaler& u, const std::vector<uint32_t>& in, int w, int h, UpscaleFilter filter) {
+            int factor = TKPEmu::Tools::GetUpscaleFactor(filter);
+            const uint32_t* out = u.Process(in.data(), w, h, filter);
+            return std::vector<uint32_t>(out, out + in.size() * factor * factor);
+        };
+        for (auto filter : { UpscaleFilter::Nearest2x, UpscaleFilter::Nearest3x, UpscaleFilter::Nearest4x }) {
+            int factor = TKPEmu::Tools::GetUpscaleFactor(filter);
+            auto out = run(upscaler, src, width, height, filter);
+            for (int y = 0; y < height * factor; y++) {
+                for (int x = 0; x < width * factor; x++)
+                    CPPUNIT_ASSERT_EQUAL(src[(y / factor) * width + x / factor], out[y * width * factor + x]);
+            }
+        }
+        auto scale2x = reference_scale2x(src, width, height);
+        CPPUNIT_ASSERT(run(upscaler, src, width, height, UpscaleFilter::Scale2x) == scale2x);
+        CPPUNIT_ASSERT(run(upscaler, src, width, height, UpscaleFilter::Scale4x) == reference_scale2x(scale2x, width * 2, height * 2));
+        // Splitting into bands on several threads changes nothing
+        for (auto filter : { UpscaleFilter::Nearest4x, UpscaleFilter::Scale2x, UpscaleFilter::Scale3x,
+                UpscaleFilter::Scale4x, UpscaleFilter::XBR2x, UpscaleFilter::XBR4x }) {
+            CPPUNIT_ASSERT(run(upscaler, src, width, height, filter) == run(threaded, src, width, height, filter));
+        }
+        // A flat frame stays flat and a diagonal edge gets blended corners
+        std::vector<uint32_t> flat(width * height, 0xFF2080C0);
+        CPPUNIT_ASSERT(run(upscaler, flat, width, height, UpscaleFilter::XBR2x) == std::vector<uint32_t>(flat.size() * 4, 0xFF2080C0));
+        std::vector<uint32_t> diagonal(width * height);
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++)
+                diagonal[y * width + x] = x > y ? 0xFFFFFFFF : 0xFF000000;
+        }
+        auto xbr = run(upscaler, diagonal, width, height, UpscaleFilter::XBR2x);
+        int blended = std::count(xbr.begin(), xbr.end(), 0xFF7F7F7Fu);
+        CPPUNIT_ASSERT(blended > 0);
+        CPPUNIT_ASSERT_EQUAL(0xFF000000u, xbr[(height * 2 - 1) * width * 2]);
+        CPPUNIT_ASSERT_EQUAL(0xFFFFFFFFu, xbr[width * 2 - 1]);
+    }
+    void TestTools::testAllocationTracker() {
+        // Nothing between the marks may allocate, assertions included, so results are
+        // collected first and checked at the end
+        TKPEmu::Tools::FrameAllocationMonitor monitor(2);
+        std::vector<int>* vector = nullptr;
+        uint64_t results[5];
+        monitor.MarkFrame();
+        vector = new std::vector<int>(100);
+        // Warm-up frames are never reported
+        results[0] = monitor.MarkFrame();
+        results[1] = monitor.MarkFrame();
+        vector->resize(1000);
+        results[2] = monitor.MarkFrame();
+        delete vector;
+        results[3] = monitor.MarkFrame();
+        monitor.Reset();
+        vector = new std::vector<int>(100);
+        results[4] = monitor.MarkFrame();
+        delete vector;
+        CPPUNIT_ASSERT_EQUAL(uint64_t(0), results[0]);
+        CPPUNIT_ASSERT_EQUAL(uint64_t(0), results[1]);
+        CPPUNIT_ASSERT_EQUAL(TKPEmu::Tools::AllocationTracking ? uint64_t(1) : uint64_t(0), results[2]);
+        // Frees don't count as allocations
+        CPPUNIT_ASSERT_EQUAL(uint64_t(0), results[3]);
+        CPPUNIT_ASSERT_EQUAL(uint64_t(0), results[4]);
+    }
+    CPPUNIT_TEST_SUITE_REGISTRATION(TestTools);
+}
@@ -0,0 +1,118 @@
+#include <include/scheduler.hxx>
+#include <include/error_factory.hxx>
+#include <string>
+
+namespace TKPEmu {
+    Scheduler::EventId Scheduler::Register(Callback callback) {
+        if (registered_ == max_events)
+            throw ErrorFactory::generate_exception(__func__, __LINE__, "Too many scheduler events");
+        callbacks_[registered_] = std::move(callback);
+        return registered_++;
+    }
+
+    void Scheduler::Schedule(EventId id, uint64_t cycle) {
+        throw_if_invalid(id, __func__);
+        Entry entry { cycle, sequence_++, id };
+        int index = positions_[id];
+        if (index == -1) {
+            index = size_++;
+            place(index, entry);
+            sift_up(index);
+        } else {
+            bool earlier = before(entry, heap_[index]);
+            place(index, entry);
+            if (earlier)
+                sift_up(index);
+            else
+                sift_down(index);
+        }
+    }
+
+    void Scheduler::Deschedule(EventId id) {
+        throw_if_invalid(id, __func__);
+        int index = positions_[id];
+        if (index != -1)
+            remove_at(index);
+    }
+
+    bool Scheduler::IsScheduled(EventId id) const {
+        throw_if_invalid(id, __func__);
+        return positions_[id] != -1;
+    }
+
+    uint64_t Scheduler::SkipToNextEvent() {
+        uint64_t next = GetNextEventCycle();
+        if (next == UINT64_MAX || next <= cycle_)
+            return 0;
+        uint64_t skipped = next - cycle_;
+        cycle_ = next;
+        return skipped;
+    }
+
+    void Scheduler::RunEvents() {
+        while (size_ && heap_[0].Cycle <= cycle_) {
+            Entry entry = heap_[0];
+            remove_at(0);
+            // The callback is free to schedule this or any other event again
+            callbacks_[entry.Id](cycle_ - entry.Cycle);
+        }
+    }
+
+    void Scheduler::Reset() {
+        size_ = 0;
+        cycle_ = 0;
+        sequence_ = 0;
+        positions_.fill(-1);
+    }
+
+    void Scheduler::throw_if_invalid(EventId id, const char* func) const {
+        if (id < 0 || id >= registered_)
+            throw ErrorFactory::generate_exception(func, __LINE__, "Invalid scheduler event id " + std::to_string(id));
+    }
+
+    void Scheduler::place(int index, const Entry& entry) {
+        heap_[index] = entry;
+        positions_[entry.Id] = index;
+    }
+
+    void Scheduler::sift_up(int index) {
+        Entry entry = heap_[index];
+        while (index > 0) {
+            int parent = (index - 1) / 2;
+            if (!before(entry, heap_[parent]))
+                break;
+            place(index, heap_[parent]);
+            index = parent;
+        }
+        place(index, entry);
+    }
+
+    void Scheduler::sift_down(int index) {
+        Entry entry = heap_[index];
+        while (true) {
+            int child = index * 2 + 1;
+            if (child >= size_)
+                break;
+            if (child + 1 < size_ && before(heap_[child + 1], heap_[child]))
+                child++;
+            if (!before(heap_[child], entry))
+                break;
+            place(index, heap_[child]);
+            index = child;
+        }
+        place(index, entry);
+    }
+
+    void Scheduler::remove_at(int index) {
+        positions_[heap_[index].Id] = -1;
+        size_--;
+        if (index == size_)
+            return;
+        bool earlier = before(heap_[size_], heap_[index]);
+        place(index, heap_[size_]);
+        if (earlier)
+            sift_up(index);
+        else
+            sift_down(index);
+    }
+}